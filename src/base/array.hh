@@ -8,6 +8,8 @@
 #include "mtypeid.hh"
 #include "header.hh"
 #include "format.hh"
+#include "container.hh"
+#include "record.hh"
 #include <iostream>
 #include <vector>
 #include <iterator>
@@ -73,37 +75,73 @@ namespace System
 			}
 	};
 
+	/*!
+	 * Writes a record. A compressed record says so in its header
+	 * (compression=shuffle-deflate, with mantissa_bits if it was
+	 * rounded), and holds the compressed bytes in its data block, so
+	 * that readers that skip it need not know about compression.
+	 */
 	template <typename T>
-	void save_to_file(std::ostream &fo, Array<T> data, std::string const &name)
+	void save_to_file(std::ostream &fo, Array<T> data, std::string const &name,
+		Compression const &c = Compression::none())
 	{
 		Header S;
 		S["name"] = name;
 		S["dtype"] = TypeRegister::name<T>();
 		S["dtype_size"] = Misc::format(sizeof(T));
+
+		if (c.enabled)
+		{
+			std::vector<char> block = compress(data.get()->data(), data.size(), c);
+			S["compression"] = "shuffle-deflate";
+			if (c.mantissa_bits > 0)
+				S["mantissa_bits"] = Misc::format(c.mantissa_bits);
+
+			if (auto co = dynamic_cast<ConanOutput *>(&fo))
+				co->add_record(name, S["dtype"], fo.tellp(), block.size());
+
+			S.to_file(fo); write_block(fo, block);
+			return;
+		}
+
+		std::streamoff p = fo.tellp();
+		if (p >= 0) align_record(S, p);
+
+		if (auto co = dynamic_cast<ConanOutput *>(&fo))
+			co->add_record(name, S["dtype"], fo.tellp(), data.size() * sizeof(T));
+
 		S.to_file(fo); data.to_file(fo);
 	}
 
+	/*!
+	 * Finds the record by name. Files written through ConanOutput carry
+	 * an index, and the record is read from its offset directly; other
+	 * files are scanned from the current position. Chunked records are
+	 * joined into one array, compressed ones are decompressed. The
+	 * position of the stream is restored afterwards.
+	 */
 	template <typename T>
 	Array<T> load_from_file(std::istream &fi, std::string const &name)
 	{
 		auto pos = fi.tellg();
+		Header S = find_record(fi, name);
 
-		while (fi.good())
+		if (S["layout"] != "chunked")
 		{
-			Header S(fi);
-			if (S["name"] != name)
-			{
-				skip_block(fi);
-			}
-			else
-			{
-				Array<T> data(fi);
-				fi.seekg(pos, std::ios::beg);
-				return data;
-			}
+			Array<T> data(0);
+			read_record_block(fi, S, *data.get());
+			fi.seekg(pos, std::ios::beg);
+			return data;
 		}
 
-		throw "Couldn't find record " + name + " in file.";
+		Array<T> data(0);
+		std::vector<T> chunk;
+		RecordReader<T> reader(fi, S);
+		while (reader.next(chunk))
+			data->insert(data->end(), chunk.begin(), chunk.end());
+
+		fi.seekg(pos, std::ios::beg);
+		return data;
 	}
 }
 
@@ -0,0 +1,114 @@
+#ifdef UNITTEST
+#include "unittest.hh"
+#include "array.hh"
+#include "history.hh"
+#include "mmap.hh"
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <iostream>
+
+using namespace System;
+
+Test::Unit Compress_test("0020 - compressed records",
+	"Losslessly compressed records should read back unchanged, and be "
+	"smaller than raw ones for smooth data. Rounding to fewer mantissa "
+	"bits should stay within the expected relative error, compress "
+	"further, and keep infinities and NaN.",
+	[] ()
+{
+	std::string fn = "0020-compress-test.conan";
+	size_t n = 1 << 18;
+
+	Array<double> a(n);
+	Array<mVector<double, 3>> x(1000);
+	Array<int> b(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		a[i] = std::sin(i * 0.001) * 100;
+		b[i] = i / 100;
+	}
+	for (size_t i = 0; i < x.size(); ++i)
+		x[i] = mVector<double, 3>({std::cos(i * 0.1), 0.5, i * 0.01});
+
+	std::vector<uint64_t> offsets;
+	{
+		ConanOutput fo(fn);
+		Header H; H["test"] = "compress";
+		History I; I.update("compress-test");
+		H.to_file(fo); I.to_file(fo);
+
+		auto mark = [&] () { offsets.push_back(fo.tellp()); };
+		mark(); save_to_file(fo, a, "raw");
+		mark(); save_to_file(fo, a, "lossless", Compression::lossless());
+		mark(); save_to_file(fo, a, "lossy", Compression::lossy(20));
+		mark(); save_to_file(fo, x, "vectors", Compression::lossy(20));
+		mark(); save_to_file(fo, b, "ints", Compression::lossless(9));
+		mark();
+		save_to_file(fo, Array<int>(3), "odd", Compression::lossless());
+
+		bool refused = false;
+		try { save_to_file(fo, b, "lossy-ints", Compression::lossy(20)); }
+		catch (char const *) { refused = true; }
+		if (not refused) throw "lossy compression of integers was accepted.";
+	}
+
+	std::ifstream fi(fn);
+	Array<double> a1 = load_from_file<double>(fi, "lossless"),
+	              a2 = load_from_file<double>(fi, "lossy");
+	Array<mVector<double, 3>> x2 = load_from_file<mVector<double, 3>>(fi, "vectors");
+	Array<int> b2 = load_from_file<int>(fi, "ints");
+	MappedArray<double> m = map_from_file<double>(fn, "lossless");
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (a1[i] != a[i] or m[i] != a[i] or b2[i] != b[i])
+			throw "lossless compression changed the data.";
+
+		if (std::abs(a2[i] - a[i]) > std::abs(a[i]) * std::pow(2.0, -20))
+			throw "lossy compression exceeds its error.";
+	}
+
+	for (size_t i = 0; i < x.size(); ++i)
+		for (unsigned k = 0; k < 3; ++k)
+			if (std::abs(x2[i][k] - x[i][k]) > std::abs(x[i][k]) * std::pow(2.0, -20))
+				throw "lossy compression of vectors exceeds its error.";
+
+	double s[4] = { std::numeric_limits<double>::infinity(),
+		std::numeric_limits<double>::quiet_NaN(), -1.0, 1.0 + 1e-12 };
+	truncate_mantissa(s, 4, 10);
+
+	// a header that announces more block sizes than the data holds
+	std::vector<char> packed = compress(a->data(), 1000, Compression::lossless());
+	std::vector<char> cut(packed.begin(), packed.begin() + 36);
+	bool caught = false;
+	try { decompress(cut, reinterpret_cast<char *>(a1->data())); }
+	catch (char const *) { caught = true; }
+	if (not caught) throw "truncated compressed block was accepted.";
+
+	// a header with zero element size
+	std::vector<char> zero(packed);
+	std::fill(zero.begin() + 8, zero.begin() + 16, 0);
+	caught = false;
+	try { decompress(zero, reinterpret_cast<char *>(a1->data())); }
+	catch (char const *) { caught = true; }
+	if (not caught) throw "zero element size was accepted.";
+
+	// twelve bytes of int do not make whole doubles
+	caught = false;
+	try { load_from_file<double>(fi, "odd"); }
+	catch (char const *) { caught = true; }
+	if (not caught) throw "record of the wrong element size was accepted.";
+
+	std::remove(fn.c_str());
+
+	size_t raw = offsets[1] - offsets[0], lossless = offsets[2] - offsets[1],
+	       lossy = offsets[3] - offsets[2];
+	std::cerr << "raw: " << raw << ", lossless: " << lossless
+	          << ", lossy (20 bits): " << lossy << " bytes.\n";
+
+	return lossless < raw and lossy < lossless / 2 and offsets[5] - offsets[4] < n
+		and std::isinf(s[0]) and std::isnan(s[1]) and s[2] == -1.0 and s[3] == 1.0;
+});
+
+#endif
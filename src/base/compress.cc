@@ -0,0 +1,165 @@
+#include "compress.hh"
+#include <zlib.h>
+#include <algorithm>
+
+using namespace System;
+
+namespace
+{
+	size_t const header_words = 4;
+
+	// byte k of element i goes to position k * m + i.
+	void shuffle(char const *in, char *out, size_t n, size_t s)
+	{
+		size_t m = n / s;
+		for (size_t i = 0; i < m; ++i)
+			for (size_t k = 0; k < s; ++k)
+				out[k * m + i] = in[i * s + k];
+		std::copy(in + m * s, in + n, out + m * s);
+	}
+
+	void unshuffle(char const *in, char *out, size_t n, size_t s)
+	{
+		size_t m = n / s;
+		for (size_t i = 0; i < m; ++i)
+			for (size_t k = 0; k < s; ++k)
+				out[i * s + k] = in[k * m + i];
+		std::copy(in + m * s, in + n, out + m * s);
+	}
+
+	template <typename Int, typename F>
+	void truncate(F *x, size_t n, unsigned bits, unsigned mantissa, unsigned width)
+	{
+		if (bits >= mantissa) return;
+
+		Int drop = mantissa - bits,
+		    half = Int(1) << (drop - 1),
+		    mask = ~((Int(1) << drop) - 1),
+		    exponent = ((Int(1) << (width - mantissa - 1)) - 1) << mantissa;
+
+		#pragma omp parallel for simd
+		for (size_t i = 0; i < n; ++i)
+		{
+			Int u;
+			std::memcpy(&u, &x[i], sizeof(F));
+			// leave infinities and NaN alone
+			if ((u & exponent) != exponent)
+				u = (u + half) & mask;
+			std::memcpy(&x[i], &u, sizeof(F));
+		}
+	}
+}
+
+std::vector<char> System::compress(char const *data, size_t n, size_t element_size, int level)
+{
+	size_t block = std::max<size_t>(1, (1 << 20) / element_size) * element_size,
+	       n_blocks = (n + block - 1) / block;
+
+	std::vector<std::vector<char>> parts(n_blocks);
+	bool ok = true;
+
+	#pragma omp parallel for schedule(dynamic)
+	for (size_t b = 0; b < n_blocks; ++b)
+	{
+		size_t size = std::min(block, n - b * block);
+		std::vector<char> shuffled(size);
+		shuffle(data + b * block, shuffled.data(), size, element_size);
+
+		uLongf out_size = compressBound(size);
+		parts[b].resize(out_size);
+		int r = compress2(reinterpret_cast<Bytef *>(parts[b].data()), &out_size,
+			reinterpret_cast<Bytef const *>(shuffled.data()), size, level);
+
+		if (r != Z_OK)
+		{
+			#pragma omp atomic write
+			ok = false;
+			continue;
+		}
+
+		parts[b].resize(out_size);
+	}
+
+	if (not ok)
+		throw "Could not compress data.";
+
+	std::vector<uint64_t> head = { n, element_size, block, n_blocks };
+	for (auto const &p : parts)
+		head.push_back(p.size());
+
+	std::vector<char> out(head.size() * sizeof(uint64_t));
+	std::memcpy(out.data(), head.data(), out.size());
+	for (auto const &p : parts)
+		out.insert(out.end(), p.begin(), p.end());
+
+	return out;
+}
+
+uint64_t System::raw_size(std::vector<char> const &in)
+{
+	uint64_t n;
+	if (in.size() < sizeof(n))
+		throw "Compressed block is too short.";
+	std::memcpy(&n, in.data(), sizeof(uint64_t));
+	return n;
+}
+
+void System::decompress(std::vector<char> const &in, char *out)
+{
+	uint64_t head[header_words];
+	if (in.size() < sizeof(head))
+		throw "Compressed block is too short.";
+	std::memcpy(head, in.data(), sizeof(head));
+
+	uint64_t n = head[0], element_size = head[1], block = head[2], n_blocks = head[3];
+	if (element_size == 0 or block == 0 or block % element_size != 0
+	    or n_blocks != (n + block - 1) / block)
+		throw "Compressed block is corrupted.";
+	if (n_blocks > (in.size() - sizeof(head)) / sizeof(uint64_t))
+		throw "Compressed block is too short.";
+
+	std::vector<uint64_t> sizes(n_blocks), offset(n_blocks + 1);
+	std::memcpy(sizes.data(), in.data() + sizeof(head), n_blocks * sizeof(uint64_t));
+
+	offset[0] = sizeof(head) + n_blocks * sizeof(uint64_t);
+	for (size_t b = 0; b < n_blocks; ++b)
+		offset[b + 1] = offset[b] + sizes[b];
+
+	if (offset[n_blocks] != in.size())
+		throw "Compressed block is corrupted.";
+
+	bool ok = true;
+
+	#pragma omp parallel for schedule(dynamic)
+	for (size_t b = 0; b < n_blocks; ++b)
+	{
+		size_t size = std::min(block, n - b * block);
+		std::vector<char> shuffled(size);
+
+		uLongf out_size = size;
+		int r = uncompress(reinterpret_cast<Bytef *>(shuffled.data()), &out_size,
+			reinterpret_cast<Bytef const *>(in.data() + offset[b]), sizes[b]);
+
+		if (r != Z_OK or out_size != size)
+		{
+			#pragma omp atomic write
+			ok = false;
+			continue;
+		}
+
+		unshuffle(shuffled.data(), out + b * block, size, element_size);
+	}
+
+	if (not ok)
+		throw "Compressed block is corrupted.";
+}
+
+void System::truncate_mantissa(double *x, size_t n, unsigned bits)
+{
+	truncate<uint64_t>(x, n, bits, 52, 64);
+}
+
+void System::truncate_mantissa(float *x, size_t n, unsigned bits)
+{
+	truncate<uint32_t>(x, n, bits, 23, 32);
+}
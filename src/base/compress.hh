@@ -0,0 +1,109 @@
+/* compress.hh
+ *
+ * compression of record data
+ */
+
+#pragma once
+
+#include "mvector.hh"
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace System
+{
+	/*!
+	 * How to compress a record. Lossless compression shuffles the bytes
+	 * of the elements, so that bytes of equal significance are stored
+	 * together, and deflates the result. For floating point data,
+	 * mantissa_bits > 0 first rounds each value to that many bits of
+	 * mantissa, which makes the low bytes compress to almost nothing.
+	 */
+	struct Compression
+	{
+		bool		enabled;
+		int		level;
+		unsigned	mantissa_bits;
+
+		Compression(bool enabled_ = false, int level_ = 4, unsigned mantissa_bits_ = 0):
+			enabled(enabled_), level(level_), mantissa_bits(mantissa_bits_) {}
+
+		static Compression none() { return Compression(); }
+		static Compression lossless(int level = 4) { return Compression(true, level); }
+		static Compression lossy(unsigned bits, int level = 4) { return Compression(true, level, bits); }
+	};
+
+	/*!
+	 * Compresses n bytes of elements of the given size. The data is cut
+	 * in blocks of about a megabyte, which are shuffled and deflated
+	 * independently over the OpenMP threads. The result starts with the
+	 * raw size, the element size, the block size and the number of
+	 * blocks, followed by the compressed size of each block, all as
+	 * uint64, and then the compressed blocks.
+	 */
+	std::vector<char> compress(char const *data, size_t n, size_t element_size, int level);
+
+	/*!
+	 * Reverses compress, writing the raw bytes to out, which should hold
+	 * raw_size(in) bytes. Blocks are inflated in parallel.
+	 */
+	void decompress(std::vector<char> const &in, char *out);
+
+	uint64_t raw_size(std::vector<char> const &in);
+
+	// rounds to the nearest value with the given number of mantissa bits.
+	void truncate_mantissa(double *x, size_t n, unsigned bits);
+	void truncate_mantissa(float *x, size_t n, unsigned bits);
+
+	// the floating point type that a T is made of, or void.
+	template <typename T>
+	struct FloatBase { typedef void type; };
+
+	template <> struct FloatBase<double> { typedef double type; };
+	template <> struct FloatBase<float> { typedef float type; };
+
+	template <typename U>
+	struct FloatBase<std::complex<U>> { typedef typename FloatBase<U>::type type; };
+
+	template <typename U, unsigned R>
+	struct FloatBase<mVector<U, R>> { typedef typename FloatBase<U>::type type; };
+
+	/*!
+	 * Rounds the floating point numbers that make up n elements of type
+	 * T to the given number of mantissa bits. Rounding data that is not
+	 * made of floating point numbers is an error.
+	 */
+	template <typename T>
+	void round_mantissa(T *data, size_t n, unsigned bits)
+	{
+		typedef typename FloatBase<T>::type F;
+
+		if constexpr (std::is_void<F>::value)
+			throw "Lossy compression is only possible for floating point data.";
+		else
+			truncate_mantissa(reinterpret_cast<F *>(data), n * sizeof(T) / sizeof(F), bits);
+	}
+
+	// compresses n elements of type T.
+	template <typename T>
+	std::vector<char> compress(T const *data, size_t n, Compression const &c)
+	{
+		typedef typename FloatBase<T>::type F;
+
+		if (c.mantissa_bits == 0)
+			return compress(reinterpret_cast<char const *>(data), n * sizeof(T),
+				sizeof(T), c.level);
+
+		// rounded data is shuffled per number instead of per element.
+		std::vector<T> copy(data, data + n);
+		round_mantissa(copy.data(), n, c.mantissa_bits);
+		return compress(reinterpret_cast<char const *>(copy.data()), n * sizeof(T),
+			sizeof(typename std::conditional<std::is_void<F>::value, T, F>::type),
+			c.level);
+	}
+}
+
+// vim:ts=4:sw=4:tw=80
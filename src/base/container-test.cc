@@ -0,0 +1,68 @@
+#ifdef UNITTEST
+#include "unittest.hh"
+#include "array.hh"
+#include "history.hh"
+#include <cstdio>
+#include <iostream>
+
+using namespace System;
+
+Test::Unit Container_test("0015 - indexed container",
+	"Records written through ConanOutput should be listed in the index "
+	"with their offsets, and load_from_file should find them in any "
+	"order. Files without an index should still be read by scanning.",
+	[] ()
+{
+	std::string fn = "0015-container-test.conan", fn_old = "0015-container-old.conan";
+
+	Header H; H["test"] = "container";
+	History I; I.update("container-test");
+	Array<double> a(1000, 1.5), c(10, -2.0);
+	Array<int> b(333, 7);
+
+	{
+		ConanOutput fo(fn);
+		H.to_file(fo); I.to_file(fo);
+		save_to_file(fo, a, "a");
+		save_to_file(fo, b, "b");
+		save_to_file(fo, c, "c");
+	}
+
+	{
+		std::ofstream fo(fn_old);
+		H.to_file(fo); I.to_file(fo);
+		save_to_file(fo, a, "a");
+		save_to_file(fo, b, "b");
+		save_to_file(fo, c, "c");
+	}
+
+	std::ifstream fi(fn);
+	RecordIndex index;
+	if (not read_index(fi, index) or index.size() != 3)
+		throw "index was not written.";
+
+	if (index["b"].size != 333 * sizeof(int) or index["b"].dtype != "int32")
+		throw "index entry has the wrong size or type.";
+
+	Header H2(fi); History I2(fi);
+	Array<double> c2 = load_from_file<double>(fi, "c");
+	Array<int> b2 = load_from_file<int>(fi, "b");
+	Array<double> a2 = load_from_file<double>(fi, "a");
+
+	std::ifstream fi_old(fn_old);
+	RecordIndex none;
+	if (read_index(fi_old, none))
+		throw "found an index in a file without one.";
+
+	Header H3(fi_old); History I3(fi_old);
+	Array<int> b3 = load_from_file<int>(fi_old, "b");
+
+	std::remove(fn.c_str());
+	std::remove(fn_old.c_str());
+
+	return H2["test"] == "container" and a2.size() == 1000 and a2[999] == 1.5
+		and b2.size() == 333 and b2[0] == 7 and c2[9] == -2.0
+		and b3.size() == 333 and b3[332] == 7;
+});
+
+#endif
@@ -0,0 +1,116 @@
+#include "container.hh"
+#include "header.hh"
+#include "misc.hh"
+#include <sstream>
+#include <cstring>
+
+using namespace System;
+
+char const ConanOutput::magic[9] = "CONANIDX";
+
+void ConanOutput::close()
+{
+	if (not is_open()) return;
+
+	uint64_t offset = tellp();
+
+	Header S;
+	S["name"] = "index";
+	S["dtype"] = "index";
+	S.to_file(*this);
+
+	std::ostringstream s;
+	for (RecordEntry const &e : entries)
+		s << e.name << "\t" << e.dtype << "\t" << e.offset << "\t" << e.size << "\n";
+
+	std::string text(s.str());
+	write_block(*this, std::vector<char>(text.begin(), text.end()));
+
+	write(reinterpret_cast<char const *>(&offset), sizeof(uint64_t));
+	write(magic, 8);
+
+	std::ofstream::close();
+}
+
+bool System::read_index(std::istream &fi, RecordIndex &index)
+{
+	auto pos = fi.tellg();
+	uint64_t offset;
+	char tag[8];
+
+	fi.seekg(-16, std::ios::end);
+	fi.read(reinterpret_cast<char *>(&offset), sizeof(uint64_t));
+	fi.read(tag, 8);
+
+	if (fi.fail() or std::memcmp(tag, ConanOutput::magic, 8) != 0)
+	{
+		fi.clear();
+		fi.seekg(pos, std::ios::beg);
+		return false;
+	}
+
+	fi.seekg(offset, std::ios::beg);
+	Header S(fi);
+	std::vector<char> raw;
+	read_block(fi, raw);
+
+	std::istringstream s(std::string(raw.begin(), raw.end()));
+	RecordEntry e;
+	while (std::getline(s, e.name, '\t') and std::getline(s, e.dtype, '\t')
+			and s >> e.offset >> e.size)
+	{
+		s.ignore(1);
+		index[e.name] = e;
+	}
+
+	fi.seekg(pos, std::ios::beg);
+	return true;
+}
+
+Header System::find_record(std::istream &fi, std::string const &name)
+{
+	RecordIndex index;
+	if (read_index(fi, index))
+	{
+		auto e = index.find(name);
+		if (e == index.end())
+			throw "Couldn't find record " + name + " in file.";
+
+		fi.seekg(e->second.offset, std::ios::beg);
+		return Header(fi);
+	}
+
+	while (fi.good())
+	{
+		Header S(fi);
+		if (S["name"] == name)
+			return S;
+
+		skip_record(fi, S);
+	}
+
+	throw "Couldn't find record " + name + " in file.";
+}
+
+void System::skip_record(std::istream &fi, Header const &S)
+{
+	auto layout = S.find("layout");
+	if (layout == S.end() or layout->second != "chunked")
+	{
+		skip_block(fi);
+		return;
+	}
+
+	// chunks up to the empty block that ends them, then the chunk index.
+	uint64_t bs;
+	do {
+		fi.read(reinterpret_cast<char *>(&bs), sizeof(uint64_t));
+		if (fi.fail())
+			throw "Could not read from file";
+
+		fi.seekg(bs, std::ios::cur);
+		fi.read(reinterpret_cast<char *>(&bs), sizeof(uint64_t));
+	} while (bs != 0);
+
+	skip_block(fi);
+}
@@ -0,0 +1,79 @@
+/* container.hh
+ *
+ * index of the records in a .conan file
+ */
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "header.hh"
+
+namespace System
+{
+	/*!
+	 * Position of a record in a .conan file: offset is that of the
+	 * record header, size the number of bytes in the data block.
+	 */
+	struct RecordEntry
+	{
+		std::string	name, dtype;
+		uint64_t	offset, size;
+	};
+
+	typedef std::map<std::string, RecordEntry> RecordIndex;
+
+	/*!
+	 * Output file that keeps track of the records written to it by
+	 * save_to_file. On closing, it appends the index as a record named
+	 * "index", followed by a footer of 16 bytes: the offset of the
+	 * index record and a magic string. Readers that do not know about
+	 * the index see one more record at the end of the file.
+	 */
+	class ConanOutput: public std::ofstream
+	{
+		std::vector<RecordEntry> entries;
+
+		public:
+			static char const magic[9];
+
+			ConanOutput(std::string const &filename):
+				std::ofstream(filename, std::ios::binary) {}
+
+			~ConanOutput() { close(); }
+
+			void add_record(std::string const &name, std::string const &dtype,
+				uint64_t offset, uint64_t size)
+			{
+				entries.push_back(RecordEntry{name, dtype, offset, size});
+			}
+
+			void close();
+	};
+
+	/*!
+	 * Reads the index from the footer of a file. Returns false, and
+	 * leaves the stream as it was, if the file has no index.
+	 */
+	bool read_index(std::istream &fi, RecordIndex &index);
+
+	/*!
+	 * Positions the stream at the data of the named record, and returns
+	 * its header. The record is found through the index if there is
+	 * one, else by scanning the records from the current position.
+	 */
+	Header find_record(std::istream &fi, std::string const &name);
+
+	/*!
+	 * Skips the data of a record whose header has just been read; a
+	 * chunked record (layout=chunked) spans several blocks.
+	 */
+	void skip_record(std::istream &fi, Header const &S);
+}
+
+// vim:ts=4:sw=4:tw=80
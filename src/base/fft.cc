@@ -4,8 +4,9 @@
 
 using namespace Fourier;
 
-Transform::Transform(std::vector<int> const &shape):
-	size(System::product(shape)), in(size), out(size)
+Transform::Transform(std::vector<int> const &shape, bool in_place):
+	size(System::product(shape)), d_in(size), d_out(in_place ? 0 : size),
+	in(d_in), out(in_place ? d_in : d_out)
 {
 	std::vector<int> ishape(shape.begin(), shape.end());
 
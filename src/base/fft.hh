@@ -41,15 +41,27 @@ namespace Fourier
 			}
 	};
 
+	/*!
+	 * Complex to complex transforms between in and out. An in-place
+	 * transform allocates a single buffer, so out refers to the same
+	 * data as in.
+	 */
 	class Transform
 	{	
-		size_t			size;
-		fftw_plan		d_plan_fwd, d_plan_bwd;
+		public:
+			typedef std::vector<std::complex<double>,
+				FFT_allocator<std::complex<double>>> Buffer;
+
+		private:
+			size_t			size;
+			fftw_plan		d_plan_fwd, d_plan_bwd;
+			Buffer			d_in, d_out;
 
 		public:
-			std::vector<std::complex<double>, FFT_allocator<std::complex<double>>> in, out;
+			Buffer			&in, &out;
 
-			Transform(std::vector<int> const &);
+			Transform(std::vector<int> const &, bool in_place = false);
+			Transform(Transform const &) = delete;
 			~Transform();
 			void forward();
 			void backward();
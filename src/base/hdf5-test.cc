@@ -0,0 +1,70 @@
+#ifdef UNITTEST
+#include "unittest.hh"
+#include "hdf5.hh"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace System;
+
+Test::Unit HDF5_test("0017 - HDF5 records",
+	"Records saved to an HDF5File should load back unchanged, including "
+	"vectors and records in groups, and slices should match the stored "
+	"data. The Header and History should survive as attributes, and a "
+	"smooth field should be compressed.",
+	[] ()
+{
+	std::string fn = "0017-hdf5-test.h5";
+	size_t n = 1 << 16;
+
+	Header H; H["test"] = "hdf5"; H["mbits"] = "8";
+	History I; I.update("hdf5-test");
+	Array<double> a(n);
+	Array<mVector<double, 3>> x(100);
+	Array<int> b(333, 7), e(0);
+	for (size_t i = 0; i < n; ++i) a[i] = i / 1024;
+	for (size_t i = 0; i < x.size(); ++i) x[i] = mVector<double, 3>({1.0 * i, 2.0, -3.0});
+
+	{
+		HDF5File fo(fn, HDF5File::WRITE);
+		fo.write_header(H, I);
+		save_to_file(fo, a, "density");
+		save_to_file(fo, x, "nodes/position");
+		save_to_file(fo, b, "nodes/faces");
+		save_to_file(fo, e, "empty");
+	}
+
+	HDF5File fi(fn);
+	Header H2; History I2;
+	fi.read_header(H2, I2);
+
+	Array<double> a2 = load_from_file<double>(fi, "density");
+	Array<mVector<double, 3>> x2 = load_from_file<mVector<double, 3>>(fi, "nodes/position");
+	Array<int> b2 = load_from_file<int>(fi, "nodes/faces"),
+	           e2 = load_from_file<int>(fi, "empty");
+	Array<double> s = load_slice<double>(fi, "density", 5000, 3000);
+
+	for (size_t i = 0; i < n; ++i)
+		if (a2[i] != a[i]) throw "record differs after reading back.";
+
+	for (size_t i = 0; i < s.size(); ++i)
+		if (s[i] != a[5000 + i]) throw "slice differs from the record.";
+
+	bool wrong_shape = false;
+	try { load_from_file<double>(fi, "nodes/position"); }
+	catch (std::string const &) { wrong_shape = true; }
+
+	bool groups = fi.exists("nodes/faces") and not fi.exists("nodes/mass")
+		and not fi.exists("walls/vertices");
+
+	std::ifstream f(fn, std::ios::binary | std::ios::ate);
+	size_t file_size = f.tellg();
+	std::remove(fn.c_str());
+
+	return H2 == H and I2.size() == 1 and I2.begin()->second == "hdf5-test"
+		and x2[99][0] == 99 and x2[99][2] == -3.0 and b2.size() == 333
+		and b2[332] == 7 and e2.size() == 0 and wrong_shape and groups
+		and file_size < n * sizeof(double) / 4;
+});
+
+#endif
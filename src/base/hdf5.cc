@@ -0,0 +1,184 @@
+#include "hdf5.hh"
+#include <sstream>
+#include <algorithm>
+
+using namespace System;
+
+namespace
+{
+	// closes an HDF5 handle when going out of scope.
+	class Handle
+	{
+		hid_t	h;
+		herr_t	(*close)(hid_t);
+
+		public:
+			Handle(hid_t h_, herr_t (*close_)(hid_t), std::string const &what):
+				h(h_), close(close_)
+			{
+				if (h < 0) throw "HDF5: could not " + what + ".";
+			}
+
+			~Handle() { close(h); }
+			operator hid_t() const { return h; }
+	};
+
+	void write_string_attribute(hid_t obj, std::string const &key, std::string const &value)
+	{
+		Handle type(H5Tcopy(H5T_C_S1), H5Tclose, "create string type");
+		H5Tset_size(type, std::max<size_t>(value.size(), 1));
+		Handle space(H5Screate(H5S_SCALAR), H5Sclose, "create dataspace");
+		Handle attr(H5Acreate2(obj, key.c_str(), type, space, H5P_DEFAULT, H5P_DEFAULT),
+			H5Aclose, "create attribute " + key);
+
+		std::string v(value.empty() ? std::string(1, '\0') : value);
+		H5Awrite(attr, type, v.data());
+	}
+
+	std::string read_string_attribute(hid_t attr)
+	{
+		Handle type(H5Aget_type(attr), H5Tclose, "read attribute type");
+		std::string value(H5Tget_size(type), '\0');
+		H5Aread(attr, type, &value[0]);
+		return value.substr(0, value.find('\0'));
+	}
+
+	herr_t collect_attribute(hid_t obj, char const *key, H5A_info_t const *, void *data)
+	{
+		Handle attr(H5Aopen(obj, key, H5P_DEFAULT), H5Aclose, "open attribute");
+		auto &S = *static_cast<std::map<std::string, std::string> *>(data);
+		S[key] = read_string_attribute(attr);
+		return 0;
+	}
+}
+
+HDF5File::HDF5File(std::string const &filename, Mode mode, unsigned compression):
+	level(compression)
+{
+	H5Eset_auto2(H5E_DEFAULT, nullptr, nullptr);
+
+	if (mode == WRITE)
+		file = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+	else
+		file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+
+	if (file < 0)
+		throw "Could not open " + filename + ".";
+}
+
+HDF5File::~HDF5File()
+{
+	H5Fclose(file);
+}
+
+void HDF5File::write_header(Header const &H, History const &I)
+{
+	for (auto const &kv : H)
+		write_string_attribute(file, kv.first, kv.second);
+
+	std::ostringstream s;
+	for (auto const &h : I)
+		s << h.first << ":" << h.second.substr(0, h.second.find('\n')) << "\n";
+
+	write_string_attribute(file, "history", s.str());
+}
+
+void HDF5File::read_header(Header &H, History &I) const
+{
+	std::map<std::string, std::string> S;
+	H5Aiterate2(file, H5_INDEX_NAME, H5_ITER_INC, nullptr, collect_attribute, &S);
+
+	std::istringstream s(S["history"]);
+	S.erase("history");
+	H.clear(); H.insert(S.begin(), S.end());
+
+	I.clear();
+	std::string line;
+	while (std::getline(s, line))
+	{
+		size_t p = line.find(':');
+		I.insert(History::value_type(from_string<time_t>(line.substr(0, p)),
+			line.substr(p + 1)));
+	}
+}
+
+bool HDF5File::exists(std::string const &name) const
+{
+	// check each group along the path, H5Lexists fails on missing parents.
+	size_t p = 0;
+	do {
+		p = name.find('/', p + 1);
+		if (H5Lexists(file, name.substr(0, p).c_str(), H5P_DEFAULT) <= 0)
+			return false;
+	} while (p != std::string::npos);
+
+	return true;
+}
+
+void HDF5File::write(std::string const &name, hid_t type, unsigned width,
+	size_t n, void const *data, std::string const &dtype)
+{
+	int rank = (width == 1 ? 1 : 2);
+	hsize_t dims[2] = { n, width };
+	Handle space(H5Screate_simple(rank, dims, nullptr), H5Sclose, "create dataspace");
+
+	Handle dcpl(H5Pcreate(H5P_DATASET_CREATE), H5Pclose, "create property list");
+	if (n > 0)
+	{
+		hsize_t row = H5Tget_size(type) * width,
+		        chunk[2] = { std::min<hsize_t>(n, std::max<hsize_t>(1, (1 << 20) / row)), width };
+		H5Pset_chunk(dcpl, rank, chunk);
+
+		if (level > 0)
+		{
+			H5Pset_shuffle(dcpl);
+			H5Pset_deflate(dcpl, level);
+		}
+	}
+
+	Handle lcpl(H5Pcreate(H5P_LINK_CREATE), H5Pclose, "create property list");
+	H5Pset_create_intermediate_group(lcpl, 1);
+
+	Handle set(H5Dcreate2(file, name.c_str(), type, space, lcpl, dcpl, H5P_DEFAULT),
+		H5Dclose, "create dataset " + name);
+
+	if (n > 0 and H5Dwrite(set, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, data) < 0)
+		throw "HDF5: could not write dataset " + name + ".";
+
+	write_string_attribute(set, "dtype", dtype);
+}
+
+size_t HDF5File::extent(std::string const &name, unsigned width) const
+{
+	Handle set(H5Dopen2(file, name.c_str(), H5P_DEFAULT), H5Dclose,
+		"find dataset " + name);
+	Handle space(H5Dget_space(set), H5Sclose, "read dataspace");
+
+	hsize_t dims[2] = { 0, 1 };
+	int rank = H5Sget_simple_extent_dims(space, dims, nullptr);
+	if (rank < 1 or rank > 2 or dims[1] != width)
+		throw "Dataset " + name + " does not have the expected shape.";
+
+	return dims[0];
+}
+
+void HDF5File::read(std::string const &name, hid_t type, unsigned width,
+	size_t offset, size_t count, void *data) const
+{
+	if (offset + count > extent(name, width))
+		throw "Slice out of range of dataset " + name + ".";
+
+	if (count == 0) return;
+
+	Handle set(H5Dopen2(file, name.c_str(), H5P_DEFAULT), H5Dclose,
+		"find dataset " + name);
+	Handle space(H5Dget_space(set), H5Sclose, "read dataspace");
+
+	int rank = (width == 1 ? 1 : 2);
+	hsize_t start[2] = { offset, 0 }, dims[2] = { count, width };
+	H5Sselect_hyperslab(space, H5S_SELECT_SET, start, nullptr, dims, nullptr);
+	Handle mem(H5Screate_simple(rank, dims, nullptr), H5Sclose, "create dataspace");
+
+	if (H5Dread(set, type, mem, space, H5P_DEFAULT, data) < 0)
+		throw "HDF5: could not read dataset " + name + ".";
+}
@@ -0,0 +1,140 @@
+/* hdf5.hh
+ *
+ * HDF5 files behind the save_to_file / load_from_file interface
+ */
+
+#pragma once
+
+#include "array.hh"
+#include "header.hh"
+#include "history.hh"
+#include "mvector.hh"
+
+#include <hdf5.h>
+#include <string>
+#include <complex>
+#include <cstdint>
+
+namespace System
+{
+	/*!
+	 * The HDF5 type of the scalars that make up a T, and how many of
+	 * them there are. Arrays of vectors become two dimensional datasets
+	 * with width columns.
+	 */
+	template <typename T>
+	struct H5Type;
+
+	template <> struct H5Type<double>
+	{ static hid_t id() { return H5T_NATIVE_DOUBLE; } enum { width = 1 }; };
+
+	template <> struct H5Type<float>
+	{ static hid_t id() { return H5T_NATIVE_FLOAT; } enum { width = 1 }; };
+
+	template <> struct H5Type<int>
+	{ static hid_t id() { return H5T_NATIVE_INT; } enum { width = 1 }; };
+
+	template <> struct H5Type<unsigned>
+	{ static hid_t id() { return H5T_NATIVE_UINT; } enum { width = 1 }; };
+
+	template <> struct H5Type<uint8_t>
+	{ static hid_t id() { return H5T_NATIVE_UINT8; } enum { width = 1 }; };
+
+	template <typename U>
+	struct H5Type<std::complex<U>>
+	{ static hid_t id() { return H5Type<U>::id(); } enum { width = 2 * H5Type<U>::width }; };
+
+	template <typename U, unsigned R>
+	struct H5Type<mVector<U, R>>
+	{ static hid_t id() { return H5Type<U>::id(); } enum { width = R * H5Type<U>::width }; };
+
+	/*!
+	 * An HDF5 file holding records as datasets. The Header is stored
+	 * as string attributes of the root group, the History as a single
+	 * attribute "history" in the same text form as in .conan files.
+	 * Datasets are chunked, in chunks of about a megabyte, and
+	 * compressed with shuffle and deflate at the given level (0 turns
+	 * compression off). Names may contain slashes, in which case the
+	 * groups are created as needed.
+	 */
+	class HDF5File
+	{
+		hid_t		file;
+		unsigned	level;
+
+		public:
+			enum Mode { READ, WRITE };
+
+			HDF5File(std::string const &filename, Mode mode = READ,
+				unsigned compression = 4);
+			~HDF5File();
+
+			HDF5File(HDF5File const &) = delete;
+			HDF5File &operator=(HDF5File const &) = delete;
+
+			void write_header(Header const &H, History const &I);
+			void read_header(Header &H, History &I) const;
+
+			bool exists(std::string const &name) const;
+
+			// writes n elements of the given width; the dtype is
+			// kept as an attribute, like in .conan files.
+			void write(std::string const &name, hid_t type, unsigned width,
+				size_t n, void const *data, std::string const &dtype);
+
+			// number of elements (rows) in the dataset.
+			size_t extent(std::string const &name, unsigned width) const;
+
+			// reads count elements, starting at offset.
+			void read(std::string const &name, hid_t type, unsigned width,
+				size_t offset, size_t count, void *data) const;
+	};
+
+	/*!
+	 * Datasets are always compressed as set for the file; of the
+	 * Compression only mantissa_bits is used, to round the data before
+	 * it is written.
+	 */
+	template <typename T>
+	void save_to_file(HDF5File &fo, Array<T> data, std::string const &name,
+		Compression const &c = Compression::none())
+	{
+		if (c.mantissa_bits > 0)
+		{
+			std::vector<T> copy(data.begin(), data.end());
+			round_mantissa(copy.data(), copy.size(), c.mantissa_bits);
+			fo.write(name, H5Type<T>::id(), H5Type<T>::width, copy.size(),
+				copy.data(), TypeRegister::name<T>());
+			return;
+		}
+
+		fo.write(name, H5Type<T>::id(), H5Type<T>::width, data.size(),
+			data.get()->data(), TypeRegister::name<T>());
+	}
+
+	template <typename T>
+	Array<T> load_from_file(HDF5File const &fi, std::string const &name)
+	{
+		size_t n = fi.extent(name, H5Type<T>::width);
+		Array<T> data(n);
+		fi.read(name, H5Type<T>::id(), H5Type<T>::width, 0, n, data.get()->data());
+		return data;
+	}
+
+	/*!
+	 * Reads count elements of a record, starting at offset. Only the
+	 * chunks that overlap the range are read; for a field on a cVector
+	 * grid, a range of indices is a set of slabs along the last axis.
+	 */
+	template <typename T>
+	Array<T> load_slice(HDF5File const &fi, std::string const &name,
+		size_t offset, size_t count)
+	{
+		Array<T> data(count);
+		fi.read(name, H5Type<T>::id(), H5Type<T>::width, offset, count,
+			data.get()->data());
+		return data;
+	}
+}
+
+// vim:ts=4:sw=4:tw=80
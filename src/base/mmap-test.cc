@@ -0,0 +1,87 @@
+#ifdef UNITTEST
+#include "unittest.hh"
+#include "mmap.hh"
+#include "history.hh"
+#include <cstdio>
+#include <iostream>
+#include <numeric>
+
+using namespace System;
+
+Test::Unit Mmap_test("0016 - mapped records",
+	"map_from_file should give a view on a record without reading it, "
+	"from files with and without an index. Records written to a file "
+	"start on a 16 byte boundary and should be mapped in place. A "
+	"damaged length marker or a wrong dtype should be detected.",
+	[] ()
+{
+	std::string fn = "0016-mmap-test.conan", fn_old = "0016-mmap-old.conan";
+
+	Header H; H["test"] = "mmap";
+	History I; I.update("mmap-test");
+	Array<double> a(1000), c(10, -2.0);
+	Array<int> b(333, 7);
+	for (size_t i = 0; i < a.size(); ++i) a[i] = i * 0.5;
+
+	{
+		ConanOutput fo(fn);
+		H.to_file(fo); I.to_file(fo);
+		save_to_file(fo, b, "b");
+		save_to_file(fo, a, "a");
+		save_to_file(fo, c, "c");
+	}
+
+	{
+		std::ofstream fo(fn_old);
+		H.to_file(fo); I.to_file(fo);
+		save_to_file(fo, c, "c");
+		save_to_file(fo, b, "b");
+		save_to_file(fo, a, "a");
+	}
+
+	MappedArray<double> a1 = map_from_file<double>(fn, "a"),
+	                    a2 = map_from_file<double>(fn_old, "a");
+	MappedArray<int> b1 = map_from_file<int>(fn, "b");
+
+	for (auto const &m : { a1, a2 })
+	{
+		if (reinterpret_cast<uintptr_t>(m.data()) % 16 != 0)
+			throw "record is not aligned.";
+
+		for (size_t i = 0; i < a.size(); ++i)
+			if (m[i] != a[i]) throw "mapped record differs.";
+	}
+
+	bool wrong_type = false;
+	try { map_from_file<float>(fn, "c"); }
+	catch (std::string const &) { wrong_type = true; }
+
+	// overwrite the trailing marker of c, the last record before the index
+	RecordIndex index;
+	{
+		std::ifstream fi(fn);
+		read_index(fi, index);
+	}
+
+	{
+		std::fstream f(fn, std::ios::in | std::ios::out | std::ios::binary);
+		uint64_t zero = 0;
+		f.seekg(index["c"].offset);
+		Header S(f); uint64_t bs;
+		f.read(reinterpret_cast<char *>(&bs), sizeof(uint64_t));
+		f.seekp(uint64_t(f.tellg()) + bs);
+		f.write(reinterpret_cast<char *>(&zero), sizeof(uint64_t));
+	}
+
+	bool corrupt = false;
+	try { map_from_file<double>(fn, "c"); }
+	catch (char const *) { corrupt = true; }
+
+	std::remove(fn.c_str());
+	std::remove(fn_old.c_str());
+
+	return wrong_type and corrupt and a1.size() == 1000 and b1.size() == 333
+		and b1[332] == 7 and std::accumulate(b1.begin(), b1.end(), 0) == 333 * 7;
+});
+
+#endif
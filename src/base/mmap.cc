@@ -0,0 +1,53 @@
+#include "mmap.hh"
+#include "history.hh"
+
+#include <fstream>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace System;
+
+RecordLocation System::locate_record(std::string const &filename, std::string const &name)
+{
+	std::ifstream fi(filename, std::ios::binary);
+	if (not fi)
+		throw "Could not open " + filename + ".";
+
+	RecordIndex index;
+	if (not read_index(fi, index))
+	{
+		Header H(fi); History I(fi);
+	}
+
+	Header S = find_record(fi, name);
+
+	RecordLocation loc;
+	loc.offset = fi.tellg();
+	loc.dtype = S["dtype"];
+	loc.in_place = (S.count("layout") == 0 and S.count("compression") == 0);
+	fi.read(reinterpret_cast<char *>(&loc.size), sizeof(uint64_t));
+	return loc;
+}
+
+std::shared_ptr<char const> System::map_file_region(std::string const &filename,
+	uint64_t offset, uint64_t size)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw "Could not open " + filename + ".";
+
+	uint64_t page = sysconf(_SC_PAGESIZE),
+	         start = offset - offset % page,
+	         length = offset + size - start;
+
+	void *m = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, start);
+	close(fd);
+
+	if (m == MAP_FAILED)
+		throw "Could not map " + filename + ".";
+
+	char const *base = static_cast<char const *>(m);
+	return std::shared_ptr<char const>(base + (offset - start),
+		[base, length] (char const *) { munmap(const_cast<char *>(base), length); });
+}
@@ -0,0 +1,134 @@
+/* mmap.hh
+ *
+ * read-only views of records in .conan files
+ */
+
+#pragma once
+
+#include "array.hh"
+#include "history.hh"
+#include <memory>
+#include <fstream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+namespace System
+{
+	/*!
+	 * Location of the data of a record: offset is that of the leading
+	 * length marker of the data block, size the number of bytes.
+	 */
+	struct RecordLocation
+	{
+		uint64_t	offset, size;
+		std::string	dtype;
+		bool		in_place;
+				// false for chunked and compressed
+				// records, which cannot be mapped
+	};
+
+	/*!
+	 * Finds a record in a file, from the index if there is one, else
+	 * by scanning the records that follow the file header and history.
+	 */
+	RecordLocation locate_record(std::string const &filename, std::string const &name);
+
+	/*!
+	 * Maps the bytes [offset, offset + size) of a file read-only. The
+	 * returned pointer keeps the mapping alive.
+	 */
+	std::shared_ptr<char const> map_file_region(std::string const &filename,
+		uint64_t offset, uint64_t size);
+
+	/*!
+	 * Read-only view of an array of T. The data is either a record
+	 * mapped from a file, shared between processes through the page
+	 * cache, or borrowed from an Array, which is kept alive by the view.
+	 */
+	template <typename T>
+	class MappedArray
+	{
+		std::shared_ptr<void const>	keep;
+		T const				*d_data;
+		size_t				d_size;
+
+		public:
+			typedef T value_type;
+			typedef T const *const_iterator;
+			typedef T const *iterator;
+
+			MappedArray():
+				d_data(nullptr), d_size(0) {}
+
+			MappedArray(Array<T> a):
+				keep(std::make_shared<Array<T>>(a)),
+				d_data(a.get()->data()), d_size(a.size()) {}
+
+			MappedArray(std::shared_ptr<void const> keep_, T const *data_, size_t size_):
+				keep(keep_), d_data(data_), d_size(size_) {}
+
+			size_t size() const { return d_size; }
+			T const *data() const { return d_data; }
+			T const &operator[](size_t i) const { return d_data[i]; }
+			const_iterator begin() const { return d_data; }
+			const_iterator end() const { return d_data + d_size; }
+	};
+
+	/*!
+	 * Opens a record as a MappedArray. The length markers around the
+	 * data block and the dtype are checked. Records written by
+	 * save_to_file to a file stream start on a 16 byte boundary, and
+	 * are used in place; records in older files may be misaligned, in
+	 * which case they are read into memory instead. So are chunked and
+	 * compressed records.
+	 */
+	template <typename T>
+	MappedArray<T> map_from_file(std::string const &filename, std::string const &name)
+	{
+		RecordLocation loc = locate_record(filename, name);
+
+		if (loc.dtype != TypeRegister::name<T>())
+			throw "Record " + name + " has type " + loc.dtype + ", expected "
+				+ TypeRegister::name<T>() + ".";
+
+		if (not loc.in_place)
+		{
+			std::ifstream fi(filename, std::ios::binary);
+			RecordIndex index;
+			if (not read_index(fi, index))
+			{
+				Header H(fi); History I(fi);
+			}
+
+			Header S = find_record(fi, name);
+			Array<T> a(0);
+			std::vector<T> chunk;
+			RecordReader<T> reader(fi, S);
+			while (reader.next(chunk))
+				a->insert(a->end(), chunk.begin(), chunk.end());
+			return MappedArray<T>(a);
+		}
+
+		auto region = map_file_region(filename, loc.offset, loc.size + 16);
+		char const *p = region.get();
+
+		uint64_t bs1, bs2;
+		std::memcpy(&bs1, p, sizeof(uint64_t));
+		std::memcpy(&bs2, p + 8 + loc.size, sizeof(uint64_t));
+		if (bs1 != loc.size or bs2 != loc.size or loc.size % sizeof(T) != 0)
+			throw "The block seems to be corrupted";
+
+		size_t n = loc.size / sizeof(T);
+		if (reinterpret_cast<uintptr_t>(p + 8) % alignof(T) != 0)
+		{
+			Array<T> a(n);
+			std::memcpy(a.get()->data(), p + 8, loc.size);
+			return MappedArray<T>(a);
+		}
+
+		return MappedArray<T>(region, reinterpret_cast<T const *>(p + 8), n);
+	}
+}
+
+// vim:ts=4:sw=4:tw=80
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <iostream>
+#include <sstream>
+#include <atomic>
+#include <algorithm>
 
 namespace Misc
 {
@@ -13,41 +16,57 @@ namespace Misc
 		return o.str();
 	}
 
+	// tic() may be called from several threads at once: the counters
+	// are atomic, and only the thread that advances the bar draws it.
+	// Loops with many cheap iterations should call tic(n) every n steps.
 	class ProgressBar
 	{
-		size_t N, i, j;
+		size_t N;
+		std::atomic<size_t> i, j;
+		std::atomic_flag drawing = ATOMIC_FLAG_INIT;
 		std::string txt;
 
 		public:
 			ProgressBar(int N_, std::string const &txt_ = "crunching ..."):
 				N(N_), i(0), j(0), txt(center(txt_, 50))
 			{
-				draw();
+				draw(0);
 			}
 
-			void tic()
+			void tic(size_t n = 1)
 			{
-				++i;
-				if (i > N) i = N;
-				else while (i * 50 / N > j)
+				// an empty loop has nothing to count; finish() fills the bar.
+				if (N == 0) return;
+
+				size_t k = std::min(i.fetch_add(n) + n, N) * 50 / N,
+				       l = j.load();
+
+				while (l < k)
 				{
-					++j;
-					draw();
+					if (j.compare_exchange_weak(l, k))
+					{
+						if (not drawing.test_and_set())
+						{
+							draw(j.load());
+							drawing.clear();
+						}
+						break;
+					}
 				}
 			}
 
 			void finish(bool newline = true)
 			{
 				j = 50;
-				draw();
+				draw(50);
 				if (newline) std::cerr << std::endl;
 			}
 
-			void draw() const
+			void draw(size_t k) const
 			{
 				std::cerr << "\r\033[m(\033[44;33;1m"
-					<< txt.substr(0, j) << "\033[m"
-					<< txt.substr(j, 50) << ")";
+					<< txt.substr(0, k) << "\033[m"
+					<< txt.substr(k, 50) << ")";
 			}
 	};
 
@@ -0,0 +1,139 @@
+#ifdef UNITTEST
+#include "unittest.hh"
+#include "array.hh"
+#include "history.hh"
+#include "mmap.hh"
+#include <cstdio>
+#include <iostream>
+
+using namespace System;
+
+Test::Unit Record_test("0018 - chunked records",
+	"A record written through RecordWriter should be read back by "
+	"RecordReader in chunks of the given size, and as a whole by "
+	"load_from_file. Records after it should still be found, with "
+	"and without a file index, and a plain record should be read by "
+	"RecordReader as a single chunk.",
+	[] ()
+{
+	std::string fn = "0018-record-test.conan", fn_old = "0018-record-old.conan";
+
+	Header H; H["test"] = "record";
+	History I; I.update("record-test");
+	Array<double> a(100, 1.5), c(10, -2.0);
+	std::vector<int> b(1050);
+	for (size_t i = 0; i < b.size(); ++i) b[i] = i;
+
+	auto write = [&] (std::ostream &fo)
+	{
+		H.to_file(fo); I.to_file(fo);
+		save_to_file(fo, a, "a");
+		{
+			RecordWriter<int> w(fo, "b", 100);
+			w.write(b.begin(), b.begin() + 500);
+			for (size_t i = 500; i < b.size(); ++i) w.push_back(b[i]);
+			if (w.size() != 1050) throw "writer miscounts elements.";
+		}
+		save_to_file(fo, c, "c");
+	};
+
+	{ ConanOutput fo(fn); write(fo); }
+	{ std::ofstream fo(fn_old); write(fo); }
+
+	for (std::string f : { fn, fn_old })
+	{
+		std::ifstream fi(f);
+		Header H2(fi); History I2(fi);
+
+		std::vector<int> chunk, joined;
+		std::vector<size_t> sizes;
+		RecordReader<int> reader(fi, "b");
+		while (reader.next(chunk))
+		{
+			sizes.push_back(chunk.size());
+			joined.insert(joined.end(), chunk.begin(), chunk.end());
+		}
+
+		if (sizes.size() != 11 or sizes[0] != 100 or sizes[10] != 50 or joined != b)
+			throw "chunks differ from what was written.";
+
+		Header S(fi);
+		if (S["name"] != "c")
+			throw "reader did not stop at the end of the record.";
+
+		fi.seekg(0); Header H3(fi); History I3(fi);
+		Array<int> b2 = load_from_file<int>(fi, "b");
+		Array<double> c2 = load_from_file<double>(fi, "c");
+		if (b2.size() != 1050 or b2[1049] != 1049 or c2[9] != -2.0)
+			throw "load_from_file fails on chunked records.";
+
+		RecordReader<double> plain(fi, "a");
+		std::vector<double> v;
+		if (not plain.next(v) or v.size() != 100 or plain.next(v))
+			throw "plain record is not read as one chunk.";
+
+		if (map_from_file<double>(f, "c")[3] != -2.0)
+			throw "could not map the record after a chunked one.";
+	}
+
+	std::ifstream fi(fn);
+	RecordIndex index;
+	read_index(fi, index);
+
+	std::remove(fn.c_str());
+	std::remove(fn_old.c_str());
+
+	return index.size() == 3 and index["b"].size == 1050 * sizeof(int)
+		and index["b"].dtype == "int32";
+});
+
+struct Node { double x[3]; double mass; int type; };
+
+Test::Unit Block_test("0019 - block writer",
+	"A record streamed through BlockWriter, through a buffer smaller "
+	"than the record, should read back as if written by save_to_file, "
+	"and be aligned for mapping. Writing fewer or more elements than "
+	"announced should be an error.",
+	[] ()
+{
+	std::string fn = "0019-block-test.conan";
+	TypeRegister::set_name<Node>("node-test");
+	size_t n = 1000;
+
+	bool too_few = false, too_many = false;
+	{
+		ConanOutput fo(fn);
+		Header H; H["test"] = "block";
+		History I; I.update("block-test");
+		H.to_file(fo); I.to_file(fo);
+
+		BlockWriter<Node> w(fo, "nodes", n, 100 * sizeof(Node));
+		for (size_t i = 0; i < n; ++i)
+			w.push_back(Node{{1.0 * i, 0, 0}, 0.5, int(i % 7)});
+
+		try { w.push_back(Node()); }
+		catch (char const *) { too_many = true; }
+		w.close();
+
+		BlockWriter<int> v(fo, "short", 10);
+		v.push_back(1);
+		try { v.close(); }
+		catch (char const *) { too_few = true; }
+	}
+
+	std::ifstream fi(fn);
+	Array<Node> a = load_from_file<Node>(fi, "nodes");
+	MappedArray<Node> m = map_from_file<Node>(fn, "nodes");
+
+	bool corrupt = false;
+	try { load_from_file<int>(fi, "short"); }
+	catch (char const *) { corrupt = true; }
+
+	std::remove(fn.c_str());
+
+	return too_few and too_many and corrupt and a.size() == n and m.size() == n
+		and a[999].x[0] == 999 and a[999].type == 999 % 7
+		and m[500].x[0] == 500 and m[500].mass == 0.5;
+});
+
+#endif
@@ -0,0 +1,304 @@
+/* record.hh
+ *
+ * chunked records, written and read one piece at a time
+ */
+
+#pragma once
+
+#include "misc.hh"
+#include "mtypeid.hh"
+#include "header.hh"
+#include "container.hh"
+#include "compress.hh"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+namespace System
+{
+	/*!
+	 * Pads the header of a record written at position p, so that the
+	 * data that follows starts on a multiple of the alignment. The data
+	 * is preceded by the header block and the leading length marker of
+	 * its own block; each entry of the header takes key=value\n.
+	 */
+	inline void align_record(Header &S, std::streamoff p, size_t alignment = 16)
+	{
+		size_t text = 0;
+		for (auto const &kv : S)
+			text += kv.first.size() + kv.second.size() + 2;
+
+		size_t start = p + 3 * sizeof(uint64_t) + text + 5;
+		S["pad"] = std::string((alignment - start % alignment) % alignment, '0');
+	}
+
+	/*!
+	 * Reads the data block of a record with header S into v, and
+	 * decompresses it if the record is compressed.
+	 */
+	template <typename T>
+	void read_record_block(std::istream &fi, Header const &S, std::vector<T> &v)
+	{
+		auto c = S.find("compression");
+		if (c == S.end())
+		{
+			read_block(fi, v);
+			return;
+		}
+
+		if (c->second != "shuffle-deflate")
+			throw "Unknown compression: " + c->second + ".";
+
+		std::vector<char> raw;
+		read_block(fi, raw);
+		if (raw_size(raw) % sizeof(T) != 0)
+			throw "Compressed record does not match the element size.";
+
+		v.resize(raw_size(raw) / sizeof(T));
+		decompress(raw, reinterpret_cast<char *>(v.data()));
+	}
+
+	/*!
+	 * Writes a record in chunks, so that the whole array never needs
+	 * to be in memory. A chunked record has layout=chunked in its
+	 * header, and consists of a framed block for each chunk, an empty
+	 * block that ends the chunks, and a chunk index: for each chunk
+	 * the offset of its block from the first one, and the number of
+	 * elements, as pairs of uint64. Elements are buffered until a
+	 * chunk is full; close() (also called by the destructor) writes
+	 * the last chunk and the index. Written to a ConanOutput, the
+	 * record is listed in the file index with the total data size.
+	 */
+	template <typename T>
+	class RecordWriter
+	{
+		std::ostream		&fo;
+		std::string		name;
+		std::vector<T>		buffer;
+		size_t			chunk_size;
+		std::streamoff		start, first;
+		std::vector<uint64_t>	index;
+		uint64_t		total;
+		bool			closed;
+
+		public:
+			RecordWriter(std::ostream &fo_, std::string const &name_,
+					size_t chunk_size_ = std::max<size_t>(1, (1 << 22) / sizeof(T))):
+				fo(fo_), name(name_), chunk_size(chunk_size_), total(0), closed(false)
+			{
+				Header S;
+				S["name"] = name;
+				S["dtype"] = TypeRegister::name<T>();
+				S["dtype_size"] = Misc::format(sizeof(T));
+				S["layout"] = "chunked";
+				S["chunk_size"] = Misc::format(chunk_size);
+
+				start = fo.tellp();
+				S.to_file(fo);
+				first = fo.tellp();
+				buffer.reserve(chunk_size);
+			}
+
+			~RecordWriter() { close(); }
+
+			RecordWriter(RecordWriter const &) = delete;
+			RecordWriter &operator=(RecordWriter const &) = delete;
+
+			// number of elements written so far
+			size_t size() const { return total + buffer.size(); }
+
+			void push_back(T const &x)
+			{
+				buffer.push_back(x);
+				if (buffer.size() == chunk_size) flush();
+			}
+
+			template <typename Iter>
+			void write(Iter begin, Iter end)
+			{
+				for (; begin != end; ++begin) push_back(*begin);
+			}
+
+			// writes the buffered elements as a chunk
+			void flush()
+			{
+				if (buffer.empty()) return;
+
+				index.push_back(uint64_t(fo.tellp() - first));
+				index.push_back(buffer.size());
+				total += buffer.size();
+
+				write_block(fo, buffer);
+				buffer.clear();
+			}
+
+			void close()
+			{
+				if (closed) return;
+
+				flush();
+				write_block(fo, std::vector<char>());
+				write_block(fo, index);
+
+				if (auto co = dynamic_cast<ConanOutput *>(&fo))
+					co->add_record(name, TypeRegister::name<T>(), start, total * sizeof(T));
+
+				closed = true;
+			}
+	};
+
+	/*!
+	 * Writes an ordinary record of n elements, whose number is known
+	 * before the elements themselves. The header and the leading length
+	 * marker are written at once; elements are gathered in a page
+	 * aligned buffer of buffer_size bytes, which is written out in one
+	 * call each time it fills up, so that the stream passes it on
+	 * without copying. close() checks that exactly n elements were
+	 * written before writing the trailing marker, and throws if not;
+	 * the record is then left without a trailing marker, and is seen
+	 * as corrupted when read. The header is padded as in save_to_file,
+	 * so that the record can be mapped with map_from_file.
+	 */
+	template <typename T>
+	class BlockWriter
+	{
+		static_assert(std::is_trivially_copyable<T>::value,
+			"BlockWriter writes the bytes of its elements");
+
+		enum { alignment = 4096 };
+
+		std::ostream	&fo;
+		uint64_t	n, count;
+		T		*buffer;
+		size_t		capacity, used;
+		bool		closed;
+
+		void flush()
+		{
+			fo.write(reinterpret_cast<char const *>(buffer), used * sizeof(T));
+			count += used;
+			used = 0;
+		}
+
+		public:
+			BlockWriter(std::ostream &fo_, std::string const &name, size_t n_,
+					size_t buffer_size = 1 << 24):
+				fo(fo_), n(n_), count(0),
+				capacity(std::max<size_t>(1, buffer_size / sizeof(T))),
+				used(0), closed(false)
+			{
+				buffer = static_cast<T *>(::operator new(capacity * sizeof(T),
+					std::align_val_t(alignment)));
+
+				Header S;
+				S["name"] = name;
+				S["dtype"] = TypeRegister::name<T>();
+				S["dtype_size"] = Misc::format(sizeof(T));
+
+				std::streamoff p = fo.tellp();
+				if (p >= 0) align_record(S, p);
+
+				if (auto co = dynamic_cast<ConanOutput *>(&fo))
+					co->add_record(name, S["dtype"], p, n * sizeof(T));
+
+				S.to_file(fo);
+				uint64_t byte_size = n * sizeof(T);
+				fo.write(reinterpret_cast<char const *>(&byte_size), sizeof(uint64_t));
+			}
+
+			~BlockWriter()
+			{
+				try { close(); } catch (...) {}
+				::operator delete(buffer, std::align_val_t(alignment));
+			}
+
+			BlockWriter(BlockWriter const &) = delete;
+			BlockWriter &operator=(BlockWriter const &) = delete;
+
+			// number of elements written so far
+			size_t size() const { return count + used; }
+
+			void push_back(T const &x)
+			{
+				if (count + used == n)
+					throw "BlockWriter: more elements than announced.";
+
+				new (buffer + used++) T(x);
+				if (used == capacity) flush();
+			}
+
+			void close()
+			{
+				if (closed) return;
+				closed = true;
+
+				flush();
+				if (count != n)
+					throw "BlockWriter: fewer elements than announced.";
+
+				uint64_t byte_size = n * sizeof(T);
+				fo.write(reinterpret_cast<char const *>(&byte_size), sizeof(uint64_t));
+			}
+	};
+
+	/*!
+	 * Reads a record one chunk at a time. Records written in one piece
+	 * by save_to_file are read as a single chunk, decompressed if need
+	 * be. The reader starts at the data of the record, as left by
+	 * find_record, and leaves the stream behind the record once all
+	 * chunks have been read.
+	 */
+	template <typename T>
+	class RecordReader
+	{
+		std::istream	&fi;
+		Header		S;
+		bool		chunked, done;
+
+		public:
+			RecordReader(std::istream &fi_, Header const &S_):
+				fi(fi_), S(S_), done(false)
+			{
+				auto layout = S.find("layout");
+				chunked = (layout != S.end() and layout->second == "chunked");
+
+				auto dtype = S.find("dtype");
+				if (dtype == S.end() or dtype->second != TypeRegister::name<T>())
+					throw "Record has a different type than requested.";
+			}
+
+			RecordReader(std::istream &fi_, std::string const &name):
+				RecordReader(fi_, find_record(fi_, name)) {}
+
+			// reads the next chunk into v; returns false, leaving v
+			// empty, when there are no more.
+			bool next(std::vector<T> &v)
+			{
+				v.clear();
+				if (done) return false;
+
+				if (not chunked)
+				{
+					read_record_block(fi, S, v);
+					done = true;
+					return true;
+				}
+
+				read_block(fi, v);
+
+				if (v.empty())
+				{
+					skip_block(fi);
+					done = true;
+					return false;
+				}
+
+				return true;
+			}
+	};
+}
+
+// vim:ts=4:sw=4:tw=80
@@ -0,0 +1,60 @@
+#ifdef UNITTEST
+#include "unittest.hh"
+#include "stencil.hh"
+#include <iostream>
+#include <random>
+
+using namespace System;
+
+template <unsigned R>
+bool check_stencil(unsigned bits, unsigned tile_bits)
+{
+	cVector<R> box(bits);
+	Array<double> f(box.size());
+	std::mt19937 gen(bits + tile_bits);
+	std::uniform_real_distribution<double> U(-1, 1);
+	for (double &x : f) x = U(gen);
+
+	Array<double> g(box.size(), 0.0);
+	Array<unsigned> visits(box.size(), 0);
+
+	Tiling<R> tile(box, 2, tile_bits);
+	for_each_stencil(tile, f, [&] (Stencil<double, R> const &s)
+	{
+		double v = 0;
+		for (unsigned k = 0; k < R; ++k)
+			v += s(k, -2) / 12. - 2. * s(k, -1) / 3.
+			   + 2. * s(k, 1) / 3. - s(k, 2) / 12.;
+
+		g[s.index()] = v + *s;
+		++visits[s.index()];
+	});
+
+	for (size_t i = 0; i < box.size(); ++i)
+	{
+		if (visits[i] != 1)
+			throw "stencil does not visit every point once.";
+
+		double v = 0;
+		for (unsigned k = 0; k < R; ++k)
+			v += f[box.sub(i, box.dx2_i[k])] / 12. - 2. * f[box.sub(i, box.dx_i[k])] / 3.
+			   + 2. * f[box.add(i, box.dx_i[k])] / 3. - f[box.add(i, box.dx2_i[k])] / 12.;
+
+		if (g[i] != v + f[i])
+			throw "tiled stencil differs from cVector neighbours.";
+	}
+
+	return true;
+}
+
+Test::Unit Stencil_test("0014 - tiled stencil",
+	"for_each_stencil should visit every grid point once, and see the "
+	"same periodic neighbours as cVector::add and sub, for tiles "
+	"smaller than the grid and for a single tile holding all of it.",
+	[] ()
+{
+	return check_stencil<3>(5, 3) and check_stencil<3>(3, 4)
+	   and check_stencil<2>(6, 4) and check_stencil<2>(2, 6);
+});
+
+#endif
@@ -0,0 +1,167 @@
+/* stencil.hh
+ *
+ * tiled stencil iteration on periodic cVector grids
+ */
+
+#pragma once
+
+#include "cvector.hh"
+#include "array.hh"
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+namespace System
+{
+	/*!
+	 * Divides a periodic grid of (2^b)^R points into cubic tiles of
+	 * (2^t)^R points. Each tile is copied into a buffer together with
+	 * a halo of the given width, so that within the tile neighbours
+	 * are found at constant offsets; the periodic wrap is only taken
+	 * when filling the halo. The buffer is laid out like cVector, with
+	 * axis 0 running fastest.
+	 */
+	template <unsigned R>
+	class Tiling
+	{
+		cVector<R> const	&box_;
+		unsigned		t, h;
+
+		public:
+			Tiling(cVector<R> const &box, unsigned halo,
+					unsigned tile_bits = (R == 3 ? 4 : 6)):
+				box_(box), t(std::min(tile_bits, box.bits())), h(halo) {}
+
+			cVector<R> const &box() const { return box_; }
+			unsigned halo() const { return h; }
+			unsigned extent() const { return 1U << t; }
+			unsigned buffer_extent() const { return extent() + 2 * h; }
+
+			size_t buffer_size() const
+			{
+				size_t n = 1;
+				for (unsigned k = 0; k < R; ++k) n *= buffer_extent();
+				return n;
+			}
+
+			size_t size() const
+			{
+				return size_t(1) << ((box_.bits() - t) * R);
+			}
+
+			// the grid coordinates of the first point of tile j
+			mVector<int, R> origin(size_t j) const
+			{
+				mVector<int, R> x;
+				size_t m = (size_t(1) << (box_.bits() - t)) - 1;
+				for (unsigned k = 0; k < R; ++k)
+					x[k] = ((j >> ((box_.bits() - t) * k)) & m) << t;
+				return x;
+			}
+	};
+
+	/*!
+	 * The view of a kernel on the data around one grid point. Values
+	 * are read at constant offsets into the tile buffer; offsets along
+	 * axis k are multiples of stride(k), and must stay within the halo.
+	 */
+	template <typename T, unsigned R>
+	class Stencil
+	{
+		T const			*p;
+		std::ptrdiff_t const	*s;
+		size_t			i;
+
+		public:
+			Stencil(T const *p_, std::ptrdiff_t const *s_, size_t i_):
+				p(p_), s(s_), i(i_) {}
+
+			// index of the centre in the cVector grid
+			size_t index() const { return i; }
+
+			std::ptrdiff_t stride(unsigned k) const { return s[k]; }
+
+			T const &operator*() const { return *p; }
+			T const &operator[](std::ptrdiff_t o) const { return p[o]; }
+
+			// the value d steps along axis k
+			T const &operator()(unsigned k, int d) const { return p[d * s[k]]; }
+
+			T const &at(mVector<int, R> const &dx) const
+			{
+				std::ptrdiff_t o = 0;
+				for (unsigned k = 0; k < R; ++k) o += dx[k] * s[k];
+				return p[o];
+			}
+	};
+
+	/*!
+	 * Calls kernel(Stencil<T, R> const &) for every point of the grid,
+	 * one tile at a time; tiles are divided over the OpenMP threads.
+	 * Within a tile the points are visited in cVector order. The kernel
+	 * may be called concurrently, and should only write to locations
+	 * that belong to its own grid point. The data may be any indexable
+	 * container with a value_type, such as Array or MappedArray.
+	 */
+	template <typename Data, unsigned R, typename Kernel>
+	void for_each_stencil(Tiling<R> const &tile, Data const &data, Kernel kernel)
+	{
+		typedef typename Data::value_type T;
+		cVector<R> const &box = tile.box();
+		int N = box.extent(), n = tile.extent(), h = tile.halo(),
+		    B = tile.buffer_extent();
+
+		std::ptrdiff_t stride[R];
+		for (unsigned k = 0; k < R; ++k)
+			stride[k] = (k == 0 ? 1 : stride[k-1] * B);
+
+		#pragma omp parallel
+		{
+			std::vector<T> buffer(tile.buffer_size());
+
+			#pragma omp for schedule(static)
+			for (size_t j = 0; j < tile.size(); ++j)
+			{
+				mVector<int, R> x0 = tile.origin(j);
+
+				// fill the buffer, row by row along axis 0.
+				size_t rows = buffer.size() / B;
+				for (size_t r = 0; r < rows; ++r)
+				{
+					size_t base = 0, q = r;
+					for (unsigned k = 1; k < R; ++k, q /= B)
+					{
+						int y = (x0[k] + int(q % B) - h) & (N - 1);
+						base |= size_t(y) << (box.bits() * k);
+					}
+
+					T *row = &buffer[r * B];
+					for (int a = 0; a < B; ++a)
+						row[a] = data[base | ((x0[0] + a - h) & (N - 1))];
+				}
+
+				// visit the interior of the tile.
+				size_t m = 1;
+				for (unsigned k = 1; k < R; ++k) m *= n;
+
+				for (size_t r = 0; r < m; ++r)
+				{
+					size_t base = 0, q = r;
+					std::ptrdiff_t o = h;
+					for (unsigned k = 1; k < R; ++k, q /= n)
+					{
+						base |= size_t(x0[k] + q % n) << (box.bits() * k);
+						o += (q % n + h) * stride[k];
+					}
+
+					for (int a = 0; a < n; ++a)
+						kernel(Stencil<T, R>(&buffer[o + a], stride,
+							base | size_t(x0[0] + a)));
+				}
+			}
+		}
+	}
+}
+
+// vim:ts=4:sw=4:tw=80
@@ -1,6 +1,7 @@
 #pragma once
 #include <algorithm>
 #include <numeric>
+#include <cmath>
 #include "../base/system.hh"
 #include "../misc/kdtree.hh"
 
@@ -26,22 +27,62 @@ inline std::function<mVector<double,R> ()>
 	};
 }
 
+// periodic wrapping to [-L/2, L/2], without branches; iL = 1/L.
+inline double mod_L(double L, double iL, double x)
+{
+	return x - L * std::nearbyint(x * iL);
+}
+
 inline double mod_L(double L, double x)
 {
-	if (x < -L/2) return x + L;
-	if (x > L/2) return x - L;
-	return x;
+	return mod_L(L, 1.0 / L, x);
+}
+
+// distance along one axis from x to the nearest periodic image of the
+// interval [x1, x2]. None of the coordinates need to lie in [0, L), so
+// a kdTree can keep particles that have crossed the boundary unwrapped.
+inline double axis_min_distance(double L, double iL, double x, double x1, double x2)
+{
+	double t = x - x1;
+	t -= L * std::floor(t * iL);
+
+	if (t <= x2 - x1) return 0;
+	return std::min(t - (x2 - x1), L - t);
+}
+
+// the same, to the farthest point; this is L/2 if the interval
+// contains the image opposite to x, else one of the end points.
+inline double axis_max_distance(double L, double iL, double x, double x1, double x2)
+{
+	double c = x + L / 2 - x1;
+	c -= L * std::floor(c * iL);
+
+	if (c <= x2 - x1) return L / 2;
+	return std::max(std::abs(mod_L(L, iL, x - x1)),
+	                std::abs(mod_L(L, iL, x - x2)));
 }
 
 template <unsigned R>
-inline mVector<double,R> dist(double L, mVector<double, R> const &A, mVector<double, R> const &B)
+inline mVector<double,R> dist(double L, double iL, mVector<double, R> const &A, mVector<double, R> const &B)
 {
 	mVector<double,R> d = (B - A);
 	for (unsigned k = 0; k < R; ++k)
-		d[k] = mod_L(L, d[k]);	
+		d[k] = mod_L(L, iL, d[k]);	
 	return d;
 }
 
+template <unsigned R>
+inline mVector<double,R> dist(double L, mVector<double, R> const &A, mVector<double, R> const &B)
+{
+	return dist(L, 1.0 / L, A, B);
+}
+
+template <unsigned R>
+inline double dsqr(double L, double iL, mVector<double,R> const &A, mVector<double,R> const &B)
+{
+	return dist(L, iL, A, B).sqr();
+}
+
 template <unsigned R>
 inline double dsqr(double L, mVector<double,R> const &A, mVector<double,R> const &B)
 {
@@ -49,81 +90,84 @@ inline double dsqr(double L, mVector<double,R> const &A, mVector<double,R> const
 }
 
 template <unsigned R>
-class Distance_squared: public kdTree::Distance<mVector<double,R>, R>
+class Distance_squared
 {
 	typedef mVector<double, R> Point;
 
 	Point A;
-	double L;
+	double L, iL;
 
 	public:
-		Distance_squared(double L_, Point const &A_): A(A_), L(L_) {}
+		Distance_squared(double L_, Point const &A_):
+			A(A_), L(L_), iL(1.0 / L_) {}
 
-		virtual double operator()(Point const &B) const
+		double operator()(Point const &B) const
 		{
-			double d = dsqr(L, A, B);
+			double d = dsqr(L, iL, A, B);
 			if (d == 0) return 1e10;
 			else return d;
 		}
 
-		virtual double operator()(kdTree::BoundingBox<Point, R> const &B) const
+		double operator()(kdTree::BoundingBox<R> const &B) const
 		{
 			bool inside = true;
 			double d = 0;
 
 			for (unsigned k = 0; k < R; ++k)
 			{
-				if (A[k] < B.max_coord(k) and A[k] >= B.min_coord(k))
+				double u = axis_min_distance(L, iL, A[k],
+					B.min_coord(k), B.max_coord(k));
+				if (u == 0)
 					continue;
 
 				inside = false;
-				d += std::min(pow(mod_L(L, A[k] - B.max_coord(k)), 2),
-					      pow(mod_L(L, A[k] - B.min_coord(k)), 2));
+				d += u * u;
 			}
 
 			return (inside ? -1 : d);
-		};
+		}
 };
 
 template <unsigned R>
-class Disc: public kdTree::Predicate<mVector<double, R>,R>
+class Disc
 {
 	typedef mVector<double, R> Point;
 
 	Point A;
-	double L, r;
+	double L, iL, r;
 
 	public:
 		Disc(double L_, Point const &A_, double a_): 
-			A(A_), L(L_), r(a_*a_) {}
+			A(A_), L(L_), iL(1.0 / L_), r(a_*a_) {}
 
 		// if for one of the coordinates the reference point is in the same range
 		// as the bounding box, that axis does not contribute to the miminum distance
-		double min_distance(kdTree::BoundingBox<Point, R> const &B) const
+		double min_distance(kdTree::BoundingBox<R> const &B) const
 		{
 			bool inside = true;
 			double d = 0;
 
 			for (unsigned k = 0; k < R; ++k)
 			{
-				if (A[k] < B.max_coord(k) and A[k] >= B.min_coord(k))
+				double u = axis_min_distance(L, iL, A[k],
+					B.min_coord(k), B.max_coord(k));
+				if (u == 0)
 					continue;
 
 				inside = false;
-				d += std::min(pow(mod_L(L, A[k] - B.max_coord(k)), 2),
-					      pow(mod_L(L, A[k] - B.min_coord(k)), 2));
+				d += u * u;
 			}
 
 			return (inside ? -1 : d);
 		}
 
-		virtual bool operator()(Point const &B) const
+		bool operator()(Point const &B) const
 		{
-			double D = dsqr(L, A, B);
+			double D = dsqr(L, iL, A, B);
 			return D < r;
 	       	}
 
-		virtual bool operator()(kdTree::BoundingBox<Point, R> const &B) const
+		bool operator()(kdTree::BoundingBox<R> const &B) const
 		{
 			//return true;
 			double D1 = min_distance(B);
@@ -132,58 +176,59 @@ class Disc: public kdTree::Predicate<mVector<double, R>,R>
 };
 
 template <unsigned R>
-class Annulus: public kdTree::Predicate<mVector<double, R>,R>
+class Annulus
 {
 	typedef mVector<double, R> Point;
 
 	Point A;
-	double L, a, b;
+	double L, iL, a, b;
 
 	public:
 		Annulus(double L_, Point const &A_, double a_, double b_): 
-			A(A_), L(L_), a(a_*a_), b(b_*b_) {}
+			A(A_), L(L_), iL(1.0 / L_), a(a_*a_), b(b_*b_) {}
 
 		// if for one of the coordinates the reference point is in the same range
 		// as the bounding box, that axis does not contribute to the miminum distance
-		double min_distance(kdTree::BoundingBox<Point, R> const &B) const
+		double min_distance(kdTree::BoundingBox<R> const &B) const
 		{
 			bool inside = true;
 			double d = 0;
 
 			for (unsigned k = 0; k < R; ++k)
 			{
-				if (A[k] < B.max_coord(k) and A[k] >= B.min_coord(k))
+				double u = axis_min_distance(L, iL, A[k],
+					B.min_coord(k), B.max_coord(k));
+				if (u == 0)
 					continue;
 
 				inside = false;
-				d += std::min(pow(mod_L(L, A[k] - B.max_coord(k)), 2),
-					      pow(mod_L(L, A[k] - B.min_coord(k)), 2));
+				d += u * u;
 			}
 
 			return (inside ? -1 : d);
 		}
 
-		// the maximum distance is always a corner of the bounding box.
-		double max_distance(kdTree::BoundingBox<Point, R> const &B) const
+		double max_distance(kdTree::BoundingBox<R> const &B) const
 		{
 			double d = 0;
 
 			for (unsigned k = 0; k < R; ++k)
 			{
-				d += std::max(pow(mod_L(L, A[k] - B.max_coord(k)), 2),
-					      pow(mod_L(L, A[k] - B.min_coord(k)), 2));
+				double u = axis_max_distance(L, iL, A[k],
+					B.min_coord(k), B.max_coord(k));
+				d += u * u;
 			}
 
 			return d;
 		}
 
-		virtual bool operator()(Point const &B) const
+		bool operator()(Point const &B) const
 		{
-			double D = dsqr(L, A, B);
+			double D = dsqr(L, iL, A, B);
 			return a <= D and D < b;
 	       	}
 
-		virtual bool operator()(kdTree::BoundingBox<Point, R> const &B) const
+		bool operator()(kdTree::BoundingBox<R> const &B) const
 		{
 			//return true;
 			double D1 = min_distance(B), D2 = max_distance(B);
@@ -192,20 +237,101 @@ class Annulus: public kdTree::Predicate<mVector<double, R>,R>
 };
 
 template <unsigned R>
-class Force: public kdTree::Visitor<mVector<double,R>>
+class Force
 {
 	typedef mVector<double, R> Point;
 
-	double L;
+	double L, iL;
 	Point A, m_total;
 
 	public:
-		Force(double L_, Point const &A_): L(L_), A(A_), m_total(0) {}
+		Force(double L_, Point const &A_): L(L_), iL(1.0 / L_), A(A_), m_total(0) {}
 
-		virtual void operator()(Point const &B)
+		void operator()(Point const &B)
 		{
-			double D = dsqr(L, A, B);
-			if (D > 1e-3) m_total += dist(L, B, A) / pow(D, 3./2);
+			double D = dsqr(L, iL, A, B);
+			if (D > 1e-3) m_total += dist(L, iL, B, A) / (D * sqrt(D));
+		}
+
+		Point sum() const { return m_total; }
+};
+
+/*
+ * Force from all particles within the annulus a <= r < b, evaluated
+ * a whole leaf of the kd-tree at a time (see Tree::traverse_leaves).
+ * The annulus test is a mask in stead of a branch, so that the loop
+ * over the points of a leaf can be vectorised.
+ */
+template <unsigned R>
+class AnnulusForce
+{
+	typedef mVector<double, R> Point;
+
+	double L, iL, a2, b2;
+	Point A, m_total;
+
+	public:
+		AnnulusForce(double L_, Point const &A_, double a_, double b_):
+			L(L_), iL(1.0 / L_), a2(std::max(a_*a_, 1e-3)), b2(b_*b_),
+			A(A_), m_total(0) {}
+
+		void operator()(double const *const *x, size_t n)
+		{
+			double f[R] = {};
+
+			#pragma omp simd reduction(+:f[:R])
+			for (size_t j = 0; j < n; ++j)
+			{
+				double d[R], D = 0;
+				for (unsigned k = 0; k < R; ++k)
+				{
+					d[k] = mod_L(L, iL, A[k] - x[k][j]);
+					D += d[k] * d[k];
+				}
+
+				bool in = (D > a2) & (D < b2);
+				double E = (in ? D : 1.0),
+				       w = (in ? 1.0 : 0.0) / (E * sqrt(E));
+
+				for (unsigned k = 0; k < R; ++k)
+					f[k] += d[k] * w;
+			}
+
+			for (unsigned k = 0; k < R; ++k)
+				m_total[k] += f[k];
+		}
+
+		Point sum() const { return m_total; }
+};
+
+/*
+ * The part of the force that is not computed on the mesh when
+ * the particle-mesh solver is given a splitting scale rs.
+ */
+template <unsigned R>
+class ShortRangeForce
+{
+	typedef mVector<double, R> Point;
+
+	double L, iL, rs;
+	Point A, m_total;
+
+	public:
+		ShortRangeForce(double L_, double rs_, Point const &A_):
+			L(L_), iL(1.0 / L_), rs(rs_), A(A_), m_total(0) {}
+
+		void operator()(Point const &B)
+		{
+			double D = dsqr(L, iL, A, B);
+			if (D <= 1e-3) return;
+
+			double r = sqrt(D), u = r / (2 * rs), g;
+			if (R == 3)
+				g = (erfc(u) + r / (rs * sqrt(M_PI)) * exp(-u*u)) / (D * r);
+			else
+				g = exp(-u*u) / D;
+
+			m_total += dist(L, iL, B, A) * g;
 		}
 
 		Point sum() const { return m_total; }
@@ -4,14 +4,53 @@
 #include "../base/progress.hh"
 
 #include "distances.hh"
+#include "pm.hh"
+#include "lloyd.hh"
+#include "integrator.hh"
+#include "stats.hh"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <chrono>
 
 using namespace System;
 
+template <unsigned R>
+void report_separation(kdTree::Tree<mVector<double, R>, R> const &T,
+	Array<mVector<double, R>> X, double L)
+{
+	auto s = Glass::separation<R>(T, X, L);
+	std::cerr << "real mean particle separation: " << s.first << std::endl;
+	std::cerr << "sqrt(<r^2> - <r>^2): " << s.second << std::endl;
+}
+
+template <unsigned R>
+void lloyd_iterations(Array<mVector<double, R>> X, double L, double mu, unsigned steps)
+{
+	report_separation<R>(kdTree::Tree<mVector<double, R>, R>(X), X, L);
+
+	// a margin of three particle separations is enough for the
+	// Voronoi cells of all particles in the box to be complete.
+	std::cerr << "triangulating ... ";
+	Glass::Lloyd<R> lloyd(L, 3 * mu, X);
+	std::cerr << lloyd.n_ghosts() << " ghost particles." << std::endl;
+
+	for (unsigned i = 0; i < steps; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		double msd = lloyd.step(X);
+
+		std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+		std::cerr << "iteration " << i << ": rms displacement " << sqrt(msd) / mu
+			<< " mu, " << dt.count() << " s\n";
+	}
+
+	std::cerr << " -> done\n";
+	report_separation<R>(kdTree::Tree<mVector<double, R>, R>(X), X, L);
+}
+
 template <unsigned R>
 void make_particle_glass(std::ostream &fo, Header const &H)
 {
@@ -24,102 +63,148 @@ void make_particle_glass(std::ostream &fo, Header const &H)
 	double frac = H.get<double>("frac"), radius = H.get<double>("radius");
 	unsigned steps = H.get<unsigned>("steps");
 
+	// decided once here, not per particle in the force loop.
+	enum Method { TREE, PM, P3M } force;
+	if (H["force"] == "tree")
+		force = TREE;
+	else if (H["force"] == "pm")
+		force = PM;
+	else if (H["force"] == "p3m")
+		force = P3M;
+	else
+		throw "unknown force method, choose tree, pm or p3m.";
+
 	Array<Point> X(M), F(M);
 	generate(X, Glass::random_uniform_particles<R>(seed, L));
 
-	double mu, z;
-	switch (R)
-	{
-		case 2: mu = L * pow(M, -1./2) / 2.0;
-			break;
-
-		case 3: mu = 0.89298 * L * pow(3.0 / (4.0 * M_PI * M), 1./3);
-			break;
-	}
+	double mu = Glass::mean_separation<R>(M, L);
 
 	std::cerr << "est. mean particle separation: " << mu << std::endl;
 
-	bool first_iteration = true;
-	for (unsigned i = 0; i < steps; ++i)
+	if (H["method"] == "lloyd")
 	{
-		double F_sum = 0;
-		kdTree::Tree<Point,R> T(X.begin(), X.end(), 
-			[] (Point const &p, int i) { return p[i]; });
+		lloyd_iterations<R>(X, L, mu, steps);
+		X.to_file(fo);
+		return;
+	}
 
-		if (first_iteration)
-		{
-			double r = 0, r2 = 0;
+	if (H["method"] != "force")
+		throw "unknown glass method, choose force or lloyd.";
+
+	// the tree is built once and refitted in each following
+	// iteration that uses it; with the pm force and no --spread, it
+	// is only built anew for the final statistics. The periodic distance measures do not need the
+	// coordinates in [0, L), so positions are only wrapped at the
+	// end: a particle crossing the boundary would otherwise jump a
+	// whole box length, and the refit would partition the tree anew
+	// from the root.
+	kdTree::Tree<Point,R> T(X);
+
+	// with the particle-mesh solver, the tree is only used for the
+	// short range correction (p3m) and for statistics.
+	System::ptr<Glass::ParticleMesh<R>> pm;
+	if (force != TREE)
+	{
+		unsigned bits = round(H.get<double>("mbits")) + H.get<unsigned>("mesh");
+		auto mesh = make_ptr<Box<R>>(1U << bits, L);
+		pm = make_ptr<Glass::ParticleMesh<R>>(mesh, (force == P3M ? 1.25 : 0.0));
+	}
 
-			for (size_t p = 0; p < M; ++p)
-			{
-				Point q = T.nearest_neighbour(Glass::Distance_squared<R>(L, X[p]));
-				double d = Glass::dsqr(L, X[p], q);
-				r += sqrt(d) / M;
-				r2 += d / M;
-			}
+	ptr<Glass::Integrator<R>> integrator;
+	if (H["integrator"] == "fire")
+		integrator = make_ptr<Glass::FIRE<R>>(frac, mu);
+	else if (H["integrator"] == "fixed")
+		integrator = make_ptr<Glass::FixedStep<R>>(frac, mu);
+	else
+		throw "unknown integrator, choose fixed or fire.";
+
+	// the run stops early when the rms force has dropped below the
+	// given fraction of its initial value, or when the relative spread
+	// of nearest neighbour distances is small enough; zero disables.
+	double tolerance = H.get<double>("tolerance"),
+	       spread = H.get<double>("spread"),
+	       F_rms_0 = 0;
+
+	bool use_tree = (force != PM or spread > 0);
+
+	unsigned i = 0;
+	for (; i < steps; ++i)
+	{
+		if (i > 0 and use_tree) T.refit();
+
+		if (i == 0)
+			report_separation<R>(T, X, L);
 
-			std::cerr << "real mean particle separation: " << r << std::endl;
-			std::cerr << "sqrt(<r^2> - <r>^2): " << sqrt(r2 - r*r) << std::endl;
+		if (spread > 0)
+		{
+			auto s = Glass::separation<R>(T, X, L);
+			if (s.second / s.first < spread)
+				break;
 		}
 
+		auto start = std::chrono::steady_clock::now();
+		Array<Point> F_mesh;
+		if (pm) F_mesh = (*pm)(X);
+
 		Misc::ProgressBar PB(M, Misc::format("iteration ", i, " ..."));
+		double F2 = 0;
 
-		#pragma omp parallel for
+		#pragma omp parallel for schedule(dynamic, 256) reduction(+:F2)
 		for (size_t p = 0; p < M; ++p)
 		{
-			double a = 0.01, b = radius * mu;
+			if (force == TREE)
+			{
+				double a = 0.01, b = radius * mu;
 
-			Glass::Force<R> f(L, X[p]);
-			T.traverse(f, Glass::Annulus<R>(L, X[p], a, b));
-			F[p] = f.sum(); 
-			
-			#pragma omp critical 
+				Glass::AnnulusForce<R> f(L, X[p], a, b);
+				T.traverse_leaves(f, Glass::Annulus<R>(L, X[p], a, b));
+				F[p] = f.sum(); 
+			}
+			else if (force == P3M)
 			{
-				F_sum += F[p].norm();
-				PB.tic();
+				double rs = pm->splitting_scale();
+
+				Glass::ShortRangeForce<R> f(L, rs, X[p]);
+				T.traverse(f, Glass::Annulus<R>(L, X[p], 0.01, 4.5 * rs));
+				F[p] = F_mesh[p] + f.sum();
 			}
+			else
+				F[p] = F_mesh[p];
+
+			F2 += F[p].sqr();
+
+			if (p % 1024 == 0) PB.tic(1024);
 		}
 		PB.finish(false);
 
-		if (first_iteration)
-		{
-			z = mu * frac * M / F_sum;
-			// std::cerr << " z-value: " << z << std::endl;
-		}
+		double F_rms = sqrt(F2 / M);
+		if (i == 0) F_rms_0 = F_rms;
+
+		std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+		std::cerr << " " << dt.count() << " s, rms force " << F_rms / F_rms_0 << "\n";
+
+		if (tolerance > 0 and F_rms < tolerance * F_rms_0)
+			break;
 
 		if (H.get<bool>("debug"))
 		{
 			for (size_t p = 0; p < M; ++p)
-				std::cout << X[p] << " " << F[p] * z << std::endl;
+				std::cout << X[p] << " " << F[p] << std::endl;
 			std::cout << std::endl << std::endl;
 		}
 
-		for (size_t p = 0; p < M; ++p)
-		{
-			X[p] += F[p] * z;
-			X[p] %= L;
-		}
-
-		first_iteration = false;
-
-		if (i == steps - 1)
-		{
-			std::cerr << " -> done\n";
-			double r = 0, r2 = 0;
-
-			for (size_t p = 0; p < M; ++p)
-			{
-				Point q = T.nearest_neighbour(Glass::Distance_squared<R>(L, X[p]));
-				double d = Glass::dsqr(L, X[p], q);
-				r += sqrt(d) / M;
-				r2 += d / M;
-			}
-
-			std::cerr << "real mean particle separation: " << r << std::endl;
-			std::cerr << "sqrt(<r^2> - <r>^2): " << sqrt(r2 - r*r) << std::endl;
-		}
+		integrator->step(X, F);
 	}
 
+	std::cerr << " -> done after " << i << " iterations\n";
+	if (use_tree)
+		T.refit();
+	else
+		T = kdTree::Tree<Point,R>(X);
+	report_separation<R>(T, X, L);
+
+	for (size_t p = 0; p < M; ++p)
+		X[p] %= L;
 
 	X.to_file(fo);
 }
@@ -158,7 +243,33 @@ void cmd_glass(int argc, char **argv)
 		        "units of the mean particle separation."}),
 		
 		Option({Option::VALUED | Option::CHECK, "", "steps", "10",
-			"number of iterations."}),
+			"maximum number of iterations."}),
+
+		Option({Option::VALUED | Option::CHECK, "", "integrator", "fixed",
+			"how to move the particles: fixed (step proportional to the "
+			"force) or fire (damped dynamics with adaptive time step)."}),
+
+		Option({Option::VALUED | Option::CHECK, "", "tolerance", "0",
+			"stop when the rms force falls below this fraction of its "
+			"initial value; 0 to always run all steps."}),
+
+		Option({Option::VALUED | Option::CHECK, "", "spread", "0",
+			"stop when the standard deviation of nearest neighbour "
+			"distances, relative to their mean, falls below this value; "
+			"0 to always run all steps."}),
+
+		Option({Option::VALUED | Option::CHECK, "", "method", "force",
+			"method to make the glass: force (repulsive gravity) or lloyd "
+			"(move particles to the centroids of their Voronoi cells)."}),
+
+		Option({Option::VALUED | Option::CHECK, "", "force", "tree",
+			"method to compute the forces: tree (direct summation within "
+			"the radius), pm (particle-mesh) or p3m (particle-mesh with a "
+			"short range correction from the tree)."}),
+
+		Option({Option::VALUED | Option::CHECK, "", "mesh", "1",
+			"2-log of the number of mesh cells per particle along each axis, "
+			"for the pm and p3m force methods."}),
 		
 		Option({0, "", "debug", "false",
 			"debug mode: output particles in text format, each iteration."}));
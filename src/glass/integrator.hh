@@ -0,0 +1,138 @@
+#pragma once
+#include <cmath>
+#include "../base/system.hh"
+
+namespace Glass
+{
+
+using System::mVector;
+
+/*!
+ * Moves the glass particles given the forces on them. Forces have
+ * arbitrary units, so both integrators calibrate their step on the
+ * first call, such that the mean displacement is frac times the mean
+ * particle separation mu.
+ */
+template <unsigned R>
+class Integrator
+{
+	public:
+		typedef mVector<double, R> Point;
+
+		virtual ~Integrator() {}
+		virtual void step(System::Array<Point> X, System::Array<Point> const &F) = 0;
+};
+
+// the original scheme: X += F * z, with z fixed after the first step.
+template <unsigned R>
+class FixedStep: public Integrator<R>
+{
+	using typename Integrator<R>::Point;
+
+	double frac, mu, z;
+
+	public:
+		FixedStep(double frac_, double mu_):
+			frac(frac_), mu(mu_), z(0) {}
+
+		void step(System::Array<Point> X, System::Array<Point> const &F)
+		{
+			size_t M = X.size();
+
+			if (z == 0)
+			{
+				double F_sum = 0;
+				#pragma omp parallel for reduction(+:F_sum)
+				for (size_t p = 0; p < M; ++p)
+					F_sum += F[p].norm();
+
+				z = mu * frac * M / F_sum;
+			}
+
+			#pragma omp parallel for
+			for (size_t p = 0; p < M; ++p)
+				X[p] += F[p] * z;
+		}
+};
+
+/*!
+ * Fast inertial relaxation engine (Bitzek et al. 2006): damped
+ * dynamics where the velocity is steered towards the force, and the
+ * time step grows as long as the power F.v stays positive. When the
+ * system overshoots, velocities are reset and the step is halved.
+ * Particles have unit mass.
+ */
+template <unsigned R>
+class FIRE: public Integrator<R>
+{
+	using typename Integrator<R>::Point;
+
+	enum { n_min = 5 };
+
+	double frac, mu, dt, dt_max, alpha;
+	unsigned n_positive;
+	System::Array<Point> V;
+
+	static constexpr double f_inc = 1.1, f_dec = 0.5,
+		alpha_start = 0.1, f_alpha = 0.99;
+
+	public:
+		FIRE(double frac_, double mu_):
+			frac(frac_), mu(mu_), dt(0), dt_max(0),
+			alpha(alpha_start), n_positive(0) {}
+
+		double time_step() const { return dt; }
+
+		void step(System::Array<Point> X, System::Array<Point> const &F)
+		{
+			size_t M = X.size();
+			double P = 0, F2 = 0, V2 = 0, F_sum = 0;
+
+			#pragma omp parallel for reduction(+:P,F2,V2,F_sum)
+			for (size_t p = 0; p < M; ++p)
+			{
+				if (dt != 0) P += F[p].dot(V[p]);
+				F2 += F[p].sqr();
+				if (dt != 0) V2 += V[p].sqr();
+				F_sum += F[p].norm();
+			}
+
+			// starting from rest, the first step moves each particle
+			// by F dt^2.
+			if (dt == 0)
+			{
+				V = System::Array<Point>(M, Point(0.0));
+				dt = sqrt(frac * mu * M / F_sum);
+				dt_max = 10 * dt;
+			}
+			else if (P > 0)
+			{
+				if (++n_positive > n_min)
+				{
+					dt = std::min(dt * f_inc, dt_max);
+					alpha *= f_alpha;
+				}
+			}
+			else
+			{
+				n_positive = 0;
+				dt *= f_dec;
+				alpha = alpha_start;
+				std::fill(V.begin(), V.end(), Point(0.0));
+				V2 = 0;
+			}
+
+			double mix = (F2 > 0 ? alpha * sqrt(V2 / F2) : 0);
+
+			#pragma omp parallel for
+			for (size_t p = 0; p < M; ++p)
+			{
+				V[p] = V[p] * (1 - alpha) + F[p] * mix;
+				V[p] += F[p] * dt;
+				X[p] += V[p] * dt;
+			}
+		}
+};
+
+} // namespace Glass
+
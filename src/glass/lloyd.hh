@@ -0,0 +1,283 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+// CGAL definitions =================================
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/Delaunay_triangulation_2.h>
+#include <CGAL/Delaunay_triangulation_3.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
+#include <CGAL/Triangulation_vertex_base_with_info_3.h>
+
+#include "../base/system.hh"
+
+namespace Glass {
+
+using System::mVector;
+
+template <unsigned R>
+class Lloyd_base;
+
+template <>
+class Lloyd_base<2>
+{
+	public:
+		enum { R = 2 };
+
+		typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
+		typedef CGAL::Triangulation_vertex_base_with_info_2<size_t, K> Vb;
+		typedef CGAL::Triangulation_data_structure_2<Vb> Tds;
+		typedef CGAL::Delaunay_triangulation_2<K, Tds> DT;
+
+		typedef DT::Point Point;
+		typedef DT::Vertex_handle Vertex_handle;
+		typedef DT::Face_handle Face_handle;
+
+		static Point make_Point(mVector<double, 2> const &p)
+			{ return Point(p[0], p[1]); }
+
+		static mVector<double, 2> Point2dVector(Point const &p)
+			{ return mVector<double, 2>({p.x(), p.y()}); }
+
+	protected:
+		DT dt;
+
+	public:
+		// the Voronoi cell is the polygon of circumcenters of
+		// the incident faces, cut in triangles around the site.
+		mVector<double, 2> centroid(Vertex_handle v) const
+		{
+			Point s = v->point();
+			double A = 0;
+			mVector<double, 2> c(0);
+
+			auto f = dt.incident_faces(v), done = f;
+			Point a = dt.dual(Face_handle(f));
+			do {
+				++f;
+				Point b = dt.dual(Face_handle(f));
+				double w = CGAL::area(s, a, b);
+				c += (Point2dVector(s) + Point2dVector(a) + Point2dVector(b)) * (w / 3);
+				A += w;
+				a = b;
+			} while (f != done);
+
+			return c / A;
+		}
+};
+
+template <>
+class Lloyd_base<3>
+{
+	public:
+		enum { R = 3 };
+
+		typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
+		typedef CGAL::Triangulation_vertex_base_with_info_3<size_t, K> Vb;
+		typedef CGAL::Triangulation_data_structure_3<Vb> Tds;
+		typedef CGAL::Delaunay_triangulation_3<K, Tds> DT;
+
+		typedef DT::Point Point;
+		typedef DT::Edge Edge;
+		typedef DT::Vertex_handle Vertex_handle;
+		typedef DT::Cell_handle Cell_handle;
+
+		static Point make_Point(mVector<double, 3> const &p)
+			{ return Point(p[0], p[1], p[2]); }
+
+		static mVector<double, 3> Point2dVector(Point const &p)
+			{ return mVector<double, 3>({p.x(), p.y(), p.z()}); }
+
+	protected:
+		DT dt;
+
+	public:
+		// each Delaunay edge of the site is dual to a face of the
+		// Voronoi cell; the faces are cut in triangles, forming
+		// tetrahedra with the site. The edges are found from the
+		// incident cells; the plain incident_edges query marks cells
+		// while it runs, and cannot be used from several threads.
+		mVector<double, 3> centroid(Vertex_handle v) const
+		{
+			Point s = v->point();
+			double V = 0;
+			mVector<double, 3> c(0);
+
+			std::vector<Cell_handle> cells;
+			std::vector<Vertex_handle> done;
+			dt.incident_cells_threadsafe(v, std::back_inserter(cells));
+
+			for (Cell_handle const &cell : cells)
+			for (int j = 0; j < 4; ++j)
+			{
+				Vertex_handle w = cell->vertex(j);
+				if (w == v or std::find(done.begin(), done.end(), w) != done.end())
+					continue;
+				done.push_back(w);
+
+				auto h = dt.incident_cells(Edge(cell, cell->index(v), j)), end = h;
+				Point p0 = dt.dual(Cell_handle(h)); ++h;
+				Point a = dt.dual(Cell_handle(h)); ++h;
+
+				for (; h != end; ++h)
+				{
+					Point b = dt.dual(Cell_handle(h));
+					double dv = std::abs(CGAL::volume(s, p0, a, b));
+					c += (Point2dVector(s) + Point2dVector(p0)
+					    + Point2dVector(a) + Point2dVector(b)) * (dv / 4);
+					V += dv;
+					a = b;
+				}
+			}
+
+			return c / V;
+		}
+};
+
+/*!
+ * Lloyd iteration on a periodic box: each step moves every particle to
+ * the centroid of its Voronoi cell. Periodicity is handled by adding
+ * ghost copies of the particles that lie within a margin of the box
+ * boundary, so that the cells of all real particles are complete. The
+ * triangulation is kept between steps: vertices are moved, and only
+ * ghosts that enter or leave the margin are inserted or removed.
+ *
+ * Vertex info encodes the particle index p and the periodic image c
+ * as p * 3^R + c, where image c shifts axis k by ((c / 3^k) % 3 - 1) L.
+ */
+template <unsigned R_>
+class Lloyd: public Lloyd_base<R_>
+{
+	public:
+		using Base = Lloyd_base<R_>;
+		using Base::R;
+		using typename Base::Point;
+		using typename Base::Vertex_handle;
+		using Base::dt;
+
+		typedef mVector<double, R> Vector;
+
+		enum { n_images = (R == 2 ? 9 : 27), centre = n_images / 2 };
+
+	private:
+		double L, margin;
+		std::vector<Vertex_handle> primary;
+		std::unordered_map<size_t, Vertex_handle> ghosts;
+
+		Vector wrap(Vector x) const
+		{
+			for (unsigned k = 0; k < R; ++k)
+				x[k] -= L * std::floor(x[k] / L);
+			return x;
+		}
+
+		Vector shift(unsigned c) const
+		{
+			Vector s;
+			for (unsigned k = 0; k < R; ++k, c /= 3)
+				s[k] = (int(c % 3) - 1) * L;
+			return s;
+		}
+
+		// an image is needed if it lands within the margin around the box.
+		bool needed(Vector const &x, unsigned c) const
+		{
+			Vector y = x + shift(c);
+			for (unsigned k = 0; k < R; ++k)
+				if (y[k] < -margin or y[k] >= L + margin)
+					return false;
+			return true;
+		}
+
+	public:
+		Lloyd(double L_, double margin_, System::Array<Vector> X):
+			L(L_), margin(margin_), primary(X.size())
+		{
+			std::vector<std::pair<Point, size_t>> sites;
+			for (size_t p = 0; p < X.size(); ++p)
+			{
+				Vector x = wrap(X[p]);
+				for (unsigned c = 0; c < n_images; ++c)
+					if (c == centre or needed(x, c))
+						sites.emplace_back(Base::make_Point(x + shift(c)), p * n_images + c);
+			}
+
+			dt.insert(sites.begin(), sites.end());
+
+			for (auto v = dt.finite_vertices_begin(); v != dt.finite_vertices_end(); ++v)
+			{
+				size_t p = v->info() / n_images;
+				unsigned c = v->info() % n_images;
+
+				if (c == centre)
+					primary[p] = v;
+				else
+					ghosts[v->info()] = v;
+			}
+		}
+
+		size_t n_ghosts() const { return ghosts.size(); }
+
+		// moves the particles in X to the centroids of their Voronoi
+		// cells, and updates the triangulation. Returns the mean
+		// squared displacement.
+		double step(System::Array<Vector> X)
+		{
+			size_t M = primary.size();
+			double msd = 0;
+
+			#pragma omp parallel for reduction(+:msd)
+			for (size_t p = 0; p < M; ++p)
+			{
+				Vector x = Base::Point2dVector(primary[p]->point()),
+				       y = Base::centroid(primary[p]);
+				msd += (y - x).sqr() / M;
+				X[p] = wrap(y);
+			}
+
+			for (size_t p = 0; p < M; ++p)
+			{
+				// a particle that would land on another one stays
+				// where it is; dt.move would merge the two vertices,
+				// leaving two particles with the same handle.
+				Vertex_handle v = dt.move_if_no_collision(
+					primary[p], Base::make_Point(X[p]));
+				if (v != primary[p])
+					X[p] = Base::Point2dVector(primary[p]->point());
+
+				for (unsigned c = 0; c < n_images; ++c)
+				{
+					if (c == centre) continue;
+
+					size_t key = p * n_images + c;
+					auto g = ghosts.find(key);
+					bool need = needed(X[p], c);
+					Point q = Base::make_Point(X[p] + shift(c));
+
+					if (g != ghosts.end())
+					{
+						if (need)
+							g->second = dt.move(g->second, q);
+						else
+						{
+							dt.remove(g->second);
+							ghosts.erase(g);
+						}
+					}
+					else if (need)
+					{
+						Vertex_handle v = dt.insert(q);
+						v->info() = key;
+						ghosts[key] = v;
+					}
+				}
+			}
+
+			return msd;
+		}
+};
+
+} // namespace Glass
+
@@ -0,0 +1,123 @@
+#pragma once
+#include <cmath>
+#include "../base/system.hh"
+#include "../base/fourier.hh"
+#include "../misc/interpol.hh"
+
+namespace Glass
+{
+
+using System::mVector;
+
+/*!
+ * Particle-mesh solver for the repulsive force between glass particles.
+ * Particles are assigned to a periodic mesh with cloud-in-cell weights,
+ * the Poisson equation is solved with FFTs, and the gradient of the
+ * potential is interpolated back to the particles with the same weights.
+ * The mean density is removed, so the force is that of the particles
+ * against a uniform background, which is what drives the glass.
+ *
+ * In three dimensions the force between two particles is d/r^3, the same
+ * as the tree code. In two dimensions the Poisson kernel gives d/r^2.
+ *
+ * Given a splitting scale rs (in mesh cells), only the long range part
+ * of the force is computed on the mesh, by multiplying with exp(-k^2 rs^2).
+ * The remainder should then be added with ShortRangeForce on the tree;
+ * this is the P3M method.
+ */
+template <unsigned R>
+class ParticleMesh
+{
+	typedef mVector<double, R> Point;
+	typedef Fourier::Fourier<R> F;
+
+	System::ptr<System::Box<R>>	box;
+	Fourier::Transform		fft;
+	Fourier::KSpace<R>		K;
+	System::Array<double>		rho, green;
+	System::Array<Point>		force;
+	double				rs;
+
+	public:
+		ParticleMesh(System::ptr<System::Box<R>> box_, double rs_ = 0):
+			box(box_),
+			fft(std::vector<int>(R, box_->N())),
+			K(Fourier::kspace<R>(box_->N(), box_->N())),
+			rho(box_->size()), green(box_->size()),
+			force(box_->size()), rs(rs_)
+		{
+			// Green's function in grid units, including the
+			// 4 pi (3D) or 2 pi (2D) of the Poisson equation
+			// and the normalisation of the backward transform.
+			auto G = F::potential();
+			double c = (R == 3 ? 4 * M_PI : 2 * M_PI) / box->size();
+
+			#pragma omp parallel for
+			for (size_t i = 1; i < box->size(); ++i)
+			{
+				auto k = K[i];
+				green[i] = c * G(k).real();
+
+				// with a splitting scale, the smoothing of the
+				// mass assignment and interpolation is divided out;
+				// the Gaussian keeps this from amplifying noise.
+				if (rs > 0)
+				{
+					double w = 1;
+					for (unsigned j = 0; j < R; ++j)
+						if (k[j] != 0) w *= pow(sin(k[j] / 2) / (k[j] / 2), 2);
+
+					green[i] *= exp(-k.sqr() * rs * rs) / (w * w);
+				}
+			}
+
+			green[0] = 0;
+		}
+
+		double splitting_scale() const { return rs * box->scale(); }
+
+		// computes the force on each of the particles X, given in
+		// physical units.
+		System::Array<Point> operator()(System::Array<Point> const &X)
+		{
+			size_t n = box->size();
+			std::fill(rho.begin(), rho.end(), 0.0);
+			Misc::Interpol::deposit(*box, X, rho, box->scale());
+
+			#pragma omp parallel for
+			for (size_t i = 0; i < n; ++i)
+				fft.in[i] = rho[i];
+
+			fft.forward();
+
+			// the force is the gradient of the potential; converting
+			// from grid units brings in a factor of scale^(1-R).
+			double u = pow(box->scale(), 1.0 - R);
+			System::Array<Fourier::complex64> phi_f(n);
+
+			#pragma omp parallel for
+			for (size_t i = 0; i < n; ++i)
+				phi_f[i] = fft.out[i] * green[i];
+
+			for (unsigned k = 0; k < R; ++k)
+			{
+				auto D = F::derivative(k);
+
+				#pragma omp parallel for
+				for (size_t i = 0; i < n; ++i)
+					fft.in[i] = phi_f[i] * D(K[i]);
+
+				fft.backward();
+
+				#pragma omp parallel for
+				for (size_t i = 0; i < n; ++i)
+					force[i][k] = fft.out[i].real() * u;
+			}
+
+			return Misc::Interpol::Linear<System::Array<Point>, R>(box, force)
+				.sample(X, box->scale());
+		}
+};
+
+} // namespace Glass
+
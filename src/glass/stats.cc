@@ -0,0 +1,131 @@
+#include "../base/system.hh"
+#include "../base/format.hh"
+#include "../base/longstring.hh"
+
+#include "stats.hh"
+
+#include <iostream>
+#include <fstream>
+
+using namespace System;
+
+template <unsigned R>
+void glass_statistics(std::istream &fi, Header const &gH, Header const &H)
+{
+	typedef mVector<double, R> Point;
+
+	double L = gH.get<double>("size");
+	unsigned k = H.get<unsigned>("neighbours"),
+		 n_bins = H.get<unsigned>("bins");
+
+	Array<Point> X(fi);
+	size_t M = X.size();
+	double mu = Glass::mean_separation<R>(M, L),
+	       r_max = H.get<double>("rmax") * mu;
+
+	std::cerr << "building tree ... ";
+	kdTree::Tree<Point, R> T(X);
+	std::cerr << "[done]\n";
+
+	std::cout << "# glass statistics; N = " << M << ", L = " << L
+		<< ", est. mean separation mu = " << mu << "\n";
+
+	// distances to the k nearest neighbours, by rank
+	std::cerr << "nearest neighbours ... ";
+	Array<double> d = Glass::knn_distances<R>(T, X, L, k);
+	std::cerr << "[done]\n";
+
+	std::cout << "# rank, <r>/mu, sqrt(<r^2> - <r>^2)/mu\n";
+	for (unsigned j = 0; j < k; ++j)
+	{
+		double r = 0, r2 = 0;
+		for (size_t p = 0; p < M; ++p)
+		{
+			r += d[p * k + j] / M;
+			r2 += d[p * k + j] * d[p * k + j] / M;
+		}
+
+		std::cout << j + 1 << " " << r / mu << " " << sqrt(r2 - r*r) / mu << "\n";
+	}
+
+	// distribution of the nearest neighbour distance
+	Glass::Histogram nn(0, r_max, n_bins);
+	for (size_t p = 0; p < M; ++p)
+		nn.add(d[p * k]);
+
+	std::cout << "\n\n# r/mu, P(r) of the nearest neighbour distance\n";
+	for (unsigned i = 0; i < nn.size(); ++i)
+		std::cout << nn.bin_centre(i) / mu << " "
+			<< nn[i] / (M * nn.bin_width() / mu) << "\n";
+
+	// radial distribution function
+	std::cerr << "pair distances ... ";
+	Glass::Histogram pairs = Glass::pair_distances<R>(T, X, L, r_max, n_bins);
+	std::cerr << "[done]\n";
+
+	double density = M / pow(L, R);
+	std::cout << "\n\n# r/mu, g(r)\n";
+	for (unsigned i = 0; i < pairs.size(); ++i)
+	{
+		double a = i * pairs.bin_width(), b = a + pairs.bin_width(),
+		       V = (R == 2 ? M_PI * (b*b - a*a) : 4./3 * M_PI * (b*b*b - a*a*a));
+
+		std::cout << pairs.bin_centre(i) / mu << " "
+			<< pairs[i] / (M * density * V) << "\n";
+	}
+}
+
+void cmd_glass_stats(int argc, char **argv)
+{
+	Argv C = read_arguments(argc, argv,
+		Option({0, "h", "help", "false",
+			"print help on the use of this program."}),
+
+		Option({Option::VALUED | Option::CHECK, "i", "id", date_string(),
+			"identifier for filenames."}),
+
+		Option({Option::VALUED | Option::CHECK, "k", "neighbours", "4",
+			"number of nearest neighbours to compute statistics for."}),
+
+		Option({Option::VALUED | Option::CHECK, "", "bins", "60",
+			"number of bins in the histograms."}),
+
+		Option({Option::VALUED | Option::CHECK, "", "rmax", "3",
+			"upper limit of the histograms, in units of the mean "
+			"particle separation."}));
+
+	if (C.get<bool>("help"))
+	{
+		std::cout << "Cosmic workset Conan, by Johan Hidding.\n\n";
+		std::cout << Misc::LongString("Statistics of a glass file: the distances "
+			"to the nearest neighbours, the distribution of the nearest neighbour "
+			"distance and the radial distribution function g(r). Output is "
+			"written to standard output as text, in blocks separated by two "
+			"empty lines.",
+			72, [] () { return " \033[34m|\033[m "; }) << std::endl;
+		C.print(std::cout);
+		exit(0);
+	}
+
+	System::Header H; H << C;
+
+	std::string fn_glass = timed_filename(C["id"], "glass", -1);
+	std::cerr << "reading glass ... " << fn_glass << "\n";
+	std::ifstream fi(fn_glass, std::ios::in | std::ios::binary);
+	if (not fi)
+		throw "Could not open " + fn_glass + ".";
+
+	System::Header 	gH(fi);
+	System::History gI(fi);
+
+	switch (gH.get<unsigned>("dim"))
+	{
+		case 2: glass_statistics<2>(fi, gH, H);
+			break;
+
+		case 3: glass_statistics<3>(fi, gH, H);
+			break;
+	}
+}
+
+Global<Command> _GLASS_STATS("glass-stats", cmd_glass_stats);
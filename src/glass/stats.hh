@@ -0,0 +1,119 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include "../base/system.hh"
+#include "distances.hh"
+
+namespace Glass
+{
+
+using System::mVector;
+
+class Histogram
+{
+	double a, b;
+	std::vector<size_t> counts;
+
+	public:
+		Histogram(double a_, double b_, unsigned n):
+			a(a_), b(b_), counts(n, 0) {}
+
+		unsigned size() const { return counts.size(); }
+		double bin_width() const { return (b - a) / counts.size(); }
+		double bin_centre(unsigned i) const { return a + (i + 0.5) * bin_width(); }
+		size_t operator[](unsigned i) const { return counts[i]; }
+
+		void add(double x)
+		{
+			if (x < a or x >= b) return;
+			++counts[static_cast<unsigned>((x - a) / bin_width())];
+		}
+
+		void add(Histogram const &o)
+		{
+			for (unsigned i = 0; i < counts.size(); ++i)
+				counts[i] += o.counts[i];
+		}
+};
+
+// estimate of the mean nearest neighbour distance of a Poisson process.
+template <unsigned R>
+double mean_separation(size_t M, double L)
+{
+	if (R == 2)
+		return L * pow(M, -1./2) / 2.0;
+	else
+		return 0.89298 * L * pow(3.0 / (4.0 * M_PI * M), 1./3);
+}
+
+// distances to the k nearest neighbours of each particle, k per particle.
+template <unsigned R>
+System::Array<double> knn_distances(kdTree::Tree<mVector<double, R>, R> const &T,
+	System::Array<mVector<double, R>> X, double L, unsigned k)
+{
+	auto nb = T.nearest_neighbours(X.size(), k, [&] (size_t p)
+	{
+		return Distance_squared<R>(L, X[p]);
+	});
+
+	System::Array<double> d(nb.size());
+	for (size_t i = 0; i < nb.size(); ++i)
+		d[i] = sqrt(nb[i].first);
+
+	return d;
+}
+
+// mean and standard deviation of the nearest neighbour distance.
+template <unsigned R>
+std::pair<double, double> separation(kdTree::Tree<mVector<double, R>, R> const &T,
+	System::Array<mVector<double, R>> X, double L)
+{
+	System::Array<double> d = knn_distances<R>(T, X, L, 1);
+	double r = 0, r2 = 0;
+	for (double a : d)
+	{
+		r += a / d.size();
+		r2 += a * a / d.size();
+	}
+
+	return std::make_pair(r, sqrt(r2 - r*r));
+}
+
+/*!
+ * Histogram of all pair distances up to r_max. Dividing the counts by
+ * those expected for a Poisson process of the same density gives the
+ * radial distribution function g(r).
+ */
+template <unsigned R>
+Histogram pair_distances(kdTree::Tree<mVector<double, R>, R> const &T,
+	System::Array<mVector<double, R>> X, double L, double r_max, unsigned n_bins)
+{
+	Histogram total(0, r_max, n_bins);
+	size_t M = X.size();
+	double iL = 1.0 / L;
+
+	#pragma omp parallel
+	{
+		Histogram H(0, r_max, n_bins);
+
+		#pragma omp for schedule(dynamic, 64) nowait
+		for (size_t p = 0; p < M; ++p)
+		{
+			auto bin = [&] (mVector<double, R> const &q)
+			{
+				double d = dsqr(L, iL, X[p], q);
+				if (d > 0) H.add(sqrt(d));
+			};
+
+			T.traverse(bin, Disc<R>(L, X[p], r_max));
+		}
+
+		#pragma omp critical
+		total.add(H);
+	}
+
+	return total;
+}
+
+} // namespace Glass
+
@@ -1,5 +1,9 @@
 #ifdef UNITTEST
 #include "distances.hh"
+#include "pm.hh"
+#include "integrator.hh"
+#include "lloyd.hh"
+#include "stats.hh"
 #include "../base/system.hh"
 #include "../base/unittest.hh"
 
@@ -7,14 +11,14 @@ using namespace System;
 
 typedef mVector<double, 2> Point;
 
-class Printer: public kdTree::Visitor<Point>
+class Printer
 {
 	std::ostream &out;
 
 	public:
 		Printer(std::ostream &out_): out(out_) {}
 
-		virtual void operator()(Point const &B)
+		void operator()(Point const &B)
 		{
 			out << B << std::endl;	
 		}
@@ -32,15 +36,259 @@ Test::Unit kdTree_test("9827 - kdTree",
 	Array<Point> X(10000);
 
 	generate(X, Glass::random_uniform_particles<2>(0, 100.0));
-	kdTree::Tree<Point,2> T(X.begin(), X.end(), [] (Point const &p, int i) { return p[i]; });
+	kdTree::Tree<Point,2> T(X);
 	Printer P(fo);
 	T.traverse(P, Glass::Annulus<2>(100, Point({20,30}), 35, 45));
 	fo << "\n\n";
 	T.traverse(P, Glass::Disc<2>(100, Point({70,80}), 40));
 	fo.close();
 
+	for (Point const &c : { Point({20, 30}), Point({99.5, 0.2}) })
+	{
+		Glass::Distance_squared<2> D(100, c);
+		Point q = *std::min_element(X.begin(), X.end(),
+			[&] (Point const &a, Point const &b) { return D(a) < D(b); });
+
+		if (D(T.nearest_neighbour(D)) != D(q))
+			throw "nearest neighbour does not match brute force.";
+	}
+
+	kdTree::Tree<Point,2> E(Array<Point>(0));
+	try
+	{
+		E.nearest_neighbour(Glass::Distance_squared<2>(100, Point({1, 1})));
+	}
+	catch (char const *)
+	{
+		return true;
+	}
+
+	return false;
+});
+
+Test::Unit kdTree_refit_test("9828 - kdTree refit",
+	"After moving the points, a refitted kdTree should give the same "
+	"answers as a brute-force search. The points drift, so that many of "
+	"them cross the periodic boundary; they are not wrapped, and the "
+	"refit should only partition a small part of the tree anew.",
+	[] ()
+{
+	typedef mVector<double, 2> Point;
+
+	Array<Point> X(10000);
+	generate(X, Glass::random_uniform_particles<2>(0, 100.0));
+	kdTree::Tree<Point,2> T(X);
+
+	// a small random step on top of a drift that moves many points
+	// across the boundary.
+	auto jitter = Glass::random_uniform_particles<2>(1, 0.2);
+	size_t rebuilt = 0;
+	for (unsigned step = 0; step < 5; ++step)
+	{
+		for (Point &p : X)
+			p += jitter() + Point({2.9, -4.1});
+		rebuilt += T.refit();
+
+		for (Point const &c : { Point({20, 30}), Point({99, 1}), Point({-0.5, 150}) })
+		{
+			Glass::Disc<2> disc(100, c, 7.5);
+			size_t n = std::count_if(X.begin(), X.end(),
+				[&] (Point const &p) { return disc(p); });
+
+			if (T.count_if(disc) != n)
+				throw "refitted tree misses points.";
+
+			Glass::Annulus<2> annulus(100, c, 2.0, 9.0);
+			size_t m = 0;
+			auto count = [&m] (Point const &) { ++m; };
+			T.traverse(count, annulus);
+
+			if (m != size_t(std::count_if(X.begin(), X.end(),
+				[&] (Point const &p) { return annulus(p); })))
+				throw "refitted tree misses points in an annulus.";
+
+			Glass::Distance_squared<2> D(100, c);
+			Point q = *std::min_element(X.begin(), X.end(),
+				[&] (Point const &a, Point const &b) { return D(a) < D(b); });
+
+			if (D(T.nearest_neighbour(D)) != D(q))
+				throw "nearest neighbour does not match brute force.";
+		}
+	}
+
+	size_t crossed = std::count_if(X.begin(), X.end(), [] (Point const &p)
+		{ return (p - p % 100.0).sqr() > 0; });
+
+	std::cerr << crossed << " points outside the box, " << rebuilt
+		<< " of " << 5 * T.n_nodes() << " nodes partitioned anew." << std::endl;
+	return crossed > 1000 and rebuilt < T.n_nodes() / 2;
+});
+
+Test::Unit PM_test("9829 - particle-mesh force",
+	"Two particles should repel each other with a force close to 1/r^2, "
+	"both from the mesh alone at a distance of several cells, and from "
+	"the mesh plus short range tree correction at a distance of one cell.",
+	[] ()
+{
+	typedef mVector<double, 3> Point;
+
+	auto box = make_ptr<Box<3>>(32, 32.0);
+	for (double d : { 1.0, 2.5, 6.0 })
+	{
+		Array<Point> X(2);
+		X[0] = Point({10.3, 12.1, 16.6});
+		X[1] = X[0] + Point({d, 0., 0.});
+
+		Glass::ParticleMesh<3> pm(box), p3m(box, 1.25);
+		Array<Point> F = pm(X), G = p3m(X);
+
+		Glass::ShortRangeForce<3> f(32.0, p3m.splitting_scale(), X[1]);
+		f(X[0]);
+		Point g = G[1] + f.sum();
+
+		std::cerr << "d = " << d << ": 1/d^2 = " << 1/(d*d)
+			<< ", pm: " << F[1] << ", p3m: " << g << std::endl;
+
+		if (fabs(g[0] * d * d - 1) > 0.05 or fabs(g[1]) + fabs(g[2]) > 0.01 / (d*d))
+			throw "p3m force does not match the direct force.";
+
+		if (d > 4 and fabs(F[1][0] * d * d - 1) > 0.05)
+			throw "pm force does not match the direct force.";
+	}
+
 	return true;
 });
 
-#endif
+Test::Unit FIRE_test("9830 - FIRE integrator",
+	"The damped dynamics should bring particles in a harmonic well to "
+	"rest at the bottom, and do so in fewer steps than the fixed step "
+	"scheme with the same initial step size.",
+	[] ()
+{
+	typedef mVector<double, 2> Point;
+
+	auto relax = [] (Glass::Integrator<2> &I)
+	{
+		Array<Point> X(100), F(100);
+		generate(X, Glass::random_uniform_particles<2>(0, 10.0));
+
+		for (unsigned i = 0; i < 1000; ++i)
+		{
+			double F2 = 0;
+			for (size_t p = 0; p < X.size(); ++p)
+			{
+				// a stiff and a soft direction
+				F[p] = Point({-(X[p][0] - 5.0), -0.01 * (X[p][1] - 5.0)});
+				F2 += F[p].sqr();
+			}
+
+			if (sqrt(F2 / X.size()) < 1e-6)
+				return i;
 
+			I.step(X, F);
+		}
+		return 1000U;
+	};
+
+	Glass::FIRE<2> fire(0.1, 1.0);
+	Glass::FixedStep<2> fixed(0.1, 1.0);
+	unsigned n_fire = relax(fire), n_fixed = relax(fixed);
+
+	std::cerr << "steps to converge, fire: " << n_fire
+		<< ", fixed: " << n_fixed << std::endl;
+
+	return n_fire < 1000 and n_fire < n_fixed;
+});
+
+Test::Unit kdTree_knn_test("9831 - kdTree k nearest neighbours",
+	"The batch k-nearest-neighbour query should find the same distances "
+	"as sorting all distances by brute force, also near the periodic "
+	"boundary.",
+	[] ()
+{
+	typedef mVector<double, 3> Point;
+
+	Array<Point> X(5000);
+	generate(X, Glass::random_uniform_particles<3>(2, 50.0));
+	kdTree::Tree<Point,3> T(X);
+
+	unsigned k = 6;
+	Array<double> d = Glass::knn_distances<3>(T, X, 50.0, k);
+
+	for (size_t p = 0; p < X.size(); p += 97)
+	{
+		std::vector<double> all;
+		for (Point const &q : X)
+			all.push_back(sqrt(Glass::Distance_squared<3>(50.0, X[p])(q)));
+		std::sort(all.begin(), all.end());
+
+		for (unsigned j = 0; j < k; ++j)
+			if (fabs(all[j] - d[p * k + j]) > 1e-12)
+				throw "k nearest neighbours do not match brute force.";
+	}
+
+	return true;
+});
+
+Test::Unit force_kernel_test("9832 - batched force kernel",
+	"The force summed a leaf at a time should match the force summed "
+	"point by point, also after the tree was refitted.",
+	[] ()
+{
+	typedef mVector<double, 3> Point;
+
+	Array<Point> X(20000);
+	generate(X, Glass::random_uniform_particles<3>(3, 100.0));
+	kdTree::Tree<Point,3> T(X);
+
+	auto jitter = Glass::random_uniform_particles<3>(4, 1.0);
+	for (unsigned step = 0; step < 2; ++step)
+	{
+		for (size_t p = 0; p < X.size(); p += 101)
+		{
+			Glass::Force<3> f(100.0, X[p]);
+			T.traverse(f, Glass::Annulus<3>(100.0, X[p], 0.01, 12.0));
+
+			Glass::AnnulusForce<3> g(100.0, X[p], 0.01, 12.0);
+			T.traverse_leaves(g, Glass::Annulus<3>(100.0, X[p], 0.01, 12.0));
+
+			if ((f.sum() - g.sum()).norm() > 1e-10 * f.sum().norm())
+				throw "batched force differs from point-wise force.";
+		}
+
+		for (Point &p : X)
+			p += jitter() - Point(0.5);
+		T.refit();
+	}
+
+	return true;
+});
+
+Test::Unit Lloyd_test("9833 - Lloyd iteration",
+	"Starting from a perturbed square lattice, Lloyd iterations should "
+	"move the particles less and less, and keep all of them in the box.",
+	[] ()
+{
+	typedef mVector<double, 2> Point;
+
+	double L = 16.0;
+	Array<Point> X(256);
+	auto jitter = Glass::random_uniform_particles<2>(2, 0.6);
+	for (size_t i = 0; i < X.size(); ++i)
+		X[i] = Point({i % 16 + 0.5, i / 16 + 0.5}) + jitter() - Point(0.3);
+
+	Glass::Lloyd<2> lloyd(L, 3.0, X);
+	double first = lloyd.step(X), last = first;
+	for (unsigned i = 0; i < 4; ++i)
+		last = lloyd.step(X);
+
+	bool inside = std::all_of(X.begin(), X.end(), [L] (Point const &p)
+		{ return p[0] >= 0 and p[0] < L and p[1] >= 0 and p[1] < L; });
+
+	std::cerr << "rms displacement, first step: " << sqrt(first)
+		<< ", fifth step: " << sqrt(last) << std::endl;
+
+	return inside and last < first / 2;
+});
+
+#endif
@@ -129,17 +129,31 @@ void Conan::compute_potential(Header const &C, Array<double> data)
 	throw "only 2 and 3 dimensions supported.";
 }
 
-void Conan::compute_displacement(Header const &C, Array<double> data, std::ostream &fo)
+template <typename Output>
+void _save_displacement(Header const &C, Array<double> data, Output &fo,
+	Compression const &c)
 {
 	unsigned dim = C.get<unsigned>("dim");
 
 	switch (dim)
 	{
-		case 2: save_to_file(fo, _compute_displacement<2>(C, data), "displacement");
+		case 2: save_to_file(fo, _compute_displacement<2>(C, data), "displacement", c);
 			return;
-		case 3: save_to_file(fo, _compute_displacement<3>(C, data), "displacement");
+		case 3: save_to_file(fo, _compute_displacement<3>(C, data), "displacement", c);
 			return;
 	}
 	throw "only 2 and 3 dimensions supported.";
 }
 
+void Conan::compute_displacement(Header const &C, Array<double> data, std::ostream &fo,
+	Compression const &c)
+{
+	_save_displacement(C, data, fo, c);
+}
+
+void Conan::compute_displacement(Header const &C, Array<double> data, HDF5File &fo,
+	Compression const &c)
+{
+	_save_displacement(C, data, fo, c);
+}
+
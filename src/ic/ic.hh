@@ -1,5 +1,6 @@
 #pragma once
 #include "../base/system.hh"
+#include "../base/hdf5.hh"
 #include <memory>
 
 namespace Conan
@@ -14,6 +15,8 @@ namespace Conan
 	extern System::Array<double> generate_random_field(System::Header const &C);
 	extern void compute_potential(System::Header const &C, System::Array<double>);
 	extern void compute_displacement(System::Header const &C, System::Array<double>,
-		std::ostream &fo);
+		std::ostream &fo, System::Compression const &c = System::Compression::none());
+	extern void compute_displacement(System::Header const &C, System::Array<double>,
+		System::HDF5File &fo, System::Compression const &c = System::Compression::none());
 }
 
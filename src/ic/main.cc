@@ -6,6 +6,29 @@
 
 using namespace System;
 
+// the density is kept exact; with --mantissa-bits the potential and
+// displacement are rounded, which is harmless for the adhesion model.
+template <typename Output>
+void write_fields(Argv const &C, Header const &H, Array<double> D, Output &fo)
+{
+	bool compress = C.get<bool>("compress");
+	unsigned bits = C.get<unsigned>("mantissa-bits");
+	Compression exact(compress), lossy(compress or bits > 0, 4, bits);
+
+	save_to_file(fo, D, "density", exact);
+
+	if (C.get<bool>("potential"))
+	{
+		Conan::compute_potential(H, D);
+		save_to_file(fo, D, "potential", lossy);
+	}
+
+	if (C.get<bool>("displacement"))
+	{
+		Conan::compute_displacement(H, D, fo, lossy);
+	}
+}
+
 void cmd_ic(int argc, char **argv)
 {
 	std::ostringstream ss;
@@ -49,7 +72,19 @@ void cmd_ic(int argc, char **argv)
 			"include the potential in the result."),
 		
 		Option(0, "z", "displacement", "false",
-			"include the Zel'dovich displacement in the result." ));
+			"include the Zel'dovich displacement in the result." ),
+
+		Option(0, "", "hdf5", "false",
+			"write <id>.density.init.h5 in HDF5 format, instead of "
+			"the .conan file."),
+
+		Option(0, "", "compress", "false",
+			"compress the records, without loss."),
+
+		Option(Option::VALUED | Option::CHECK, "", "mantissa-bits", "0",
+			"round the potential and displacement to this many bits "
+			"of mantissa (of 52), and compress them. The default, 0, "
+			"keeps them exact."));
 
 	if (C.get<bool>("help"))
 	{
@@ -62,20 +97,16 @@ void cmd_ic(int argc, char **argv)
 	History I; I << C;
 	Array<double> D = Conan::generate_random_field(H);
 
-	std::ofstream fo(C["id"] + ".density.init.conan"); H.to_file(fo); I.to_file(fo);
-	save_to_file(fo, D, "density");
-
-	if (C.get<bool>("potential"))
-	{
-		Conan::compute_potential(H, D);
-		save_to_file(fo, D, "potential");
-	}
-
-	if (C.get<bool>("displacement"))
+	if (C.get<bool>("hdf5"))
 	{
-		Conan::compute_displacement(H, D, fo);
+		HDF5File fo(C["id"] + ".density.init.h5", HDF5File::WRITE);
+		fo.write_header(H, I);
+		write_fields(C, H, D, fo);
+		return;
 	}
 
+	ConanOutput fo(C["id"] + ".density.init.conan"); H.to_file(fo); I.to_file(fo);
+	write_fields(C, H, D, fo);
 	fo.close();
 }
 
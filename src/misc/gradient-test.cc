@@ -0,0 +1,115 @@
+#ifdef UNITTEST
+#include "../base/unittest.hh"
+#include "../base/system.hh"
+#include "gradient.hh"
+#include <iostream>
+
+using namespace System;
+
+template <unsigned R>
+void check_gradient_field(unsigned bits, unsigned long seed)
+{
+	auto box = make_ptr<BoxConfig<R>>(bits, 1.0);
+	Array<double> f(box->size());
+	generate(f, Gaussian_white_noise(seed));
+
+	Misc::Gradient<R> G(box, f);
+	Misc::GradientField<R> F(box, f);
+
+	std::vector<size_t> expected;
+	for (size_t i = 0; i < box->size(); ++i)
+	{
+		for (unsigned k = 0; k < R; ++k)
+			if (F.component(k)[i] != G.fdi(i, k))
+				throw "gradient field differs from Gradient::fdi.";
+
+		if (G.root_potentially_within_cell(i))
+			expected.push_back(i);
+	}
+
+	std::vector<size_t> found = F.root_candidates();
+	std::cerr << R << "D: " << found.size() << " candidate cells." << std::endl;
+
+	if (found != expected)
+		throw "root candidates differ from Gradient::root_potentially_within_cell.";
+}
+
+Test::Unit Gradient_field_test("0023 - gradient field",
+	"The precomputed gradient field should equal the on-demand "
+	"finite differences, and the single pass over the signs should "
+	"find the same candidate root cells.",
+	[] ()
+{
+	check_gradient_field<2>(6, 11);
+	check_gradient_field<3>(5, 12);
+	return true;
+});
+
+Test::Unit Gradient_root_test("0024 - root refinement",
+	"A sum of cosines on the torus has 2^R critical points at known "
+	"positions; Newton refinement in the candidate cells should find "
+	"them well within a cell, with the right Morse index, and the "
+	"batch should agree with Gradient::find_root.",
+	[] ()
+{
+	unsigned bits = 4, N = 1 << bits;
+	double phi[3] = { 0.3, 0.1, 0.2 }, a[3] = { 1.0, 0.9, 0.8 };
+	auto box = make_ptr<BoxConfig<3>>(bits, 2.0 * N);
+	Array<double> f(box->size());
+
+	for (size_t i = 0; i < box->size(); ++i)
+	{
+		mVector<double, 3> x = box->box().dvec(i);
+		f[i] = 0;
+		for (unsigned k = 0; k < 3; ++k)
+			f[i] += a[k] * cos(2 * M_PI * (x[k] + phi[k]) / N);
+	}
+
+	Misc::GradientField<3> F(box, f);
+	Misc::Gradient<3> G(box, f);
+	DMT::HessianBase<3> H(box, f);
+
+	std::vector<size_t> cells = F.root_candidates();
+	auto roots = F.find_roots(cells, H, box->scale2());
+
+	DMT::HessianStream<3> S(box, f);
+	auto streamed = F.find_roots(cells, S, box->scale2());
+	for (size_t j = 0; j < roots.size(); ++j)
+		if (streamed[j].converged != roots[j].converged or (roots[j].converged and
+		    ((streamed[j].x - roots[j].x).norm() > 1e-12 or streamed[j].index != roots[j].index)))
+			throw "roots from the streamed Hessian differ.";
+
+	std::vector<unsigned> n(4, 0);
+	double err = 0;
+	for (size_t j = 0; j < roots.size(); ++j)
+	{
+		if (not roots[j].converged) continue;
+
+		// the root lies at -phi or N/2 - phi along each axis; it is
+		// a maximum along the axes where it lies at -phi.
+		unsigned index = 0;
+		for (unsigned k = 0; k < 3; ++k)
+		{
+			double y = roots[j].x[k] + phi[k];
+			double d = y - (N / 2) * std::round(y / (N / 2));
+			err = std::max(err, std::abs(d));
+			if (int(std::round(y / (N / 2))) % 2 == 0) ++index;
+		}
+
+		if (index != roots[j].index)
+			throw "wrong Morse index for refined root.";
+		++n[index];
+
+		Misc::Root<3> r = G.find_root(cells[j], H, box->scale2());
+		if ((r.x - roots[j].x).norm() > 1e-6 or r.index != roots[j].index)
+			throw "Gradient::find_root differs from the batch.";
+	}
+
+	std::cerr << cells.size() << " candidates, roots per index: " << n[0] << " "
+		<< n[1] << " " << n[2] << " " << n[3] << ", max error " << err
+		<< " cells." << std::endl;
+
+	return n == std::vector<unsigned>({1, 3, 3, 1}) and err < 1e-2;
+});
+
+#endif
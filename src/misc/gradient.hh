@@ -1,21 +1,147 @@
 #pragma once
 #include "../base/mvector.hh"
 #include "../base/boxconfig.hh"
+#include "../base/stencil.hh"
+#include "../base/mmap.hh"
+#include "hessian.hh"
+
+#include <vector>
+#include <algorithm>
 
 namespace Misc
 {
+	/*!
+	 * A root of the gradient, in grid units. The Morse index is the
+	 * number of negative eigenvalues of the Hessian at the root:
+	 * 0 for a minimum, R for a maximum, saddles in between.
+	 */
+	template <unsigned R>
+	struct Root
+	{
+		System::mVector<double, R>	x;
+		unsigned			index;
+		bool				converged;
+	};
+
+	/*!
+	 * Newton iteration for a root of the gradient within one grid cell.
+	 * The gradient and the Hessian are interpolated linearly between the
+	 * 2^R corners, given in the order of cVector::sq_i; the Hessian is
+	 * stored as its lower triangle, in the order of HessianBase. The
+	 * symmetric system is solved by LDL^T decomposition, whose pivots
+	 * have the signs of the eigenvalues (Sylvester's law of inertia).
+	 * The result is in units of the cell, relative to its first corner;
+	 * it counts as converged when the step becomes small and the root
+	 * lies within the cell.
+	 */
+	template <unsigned R>
+	Root<R> newton_in_cell(System::mVector<double, R> const *g,
+		System::mVector<double, R * (R + 1) / 2> const *h)
+	{
+		typedef System::mVector<double, R> Vector;
+		enum { n_iter = 20 };
+
+		Root<R> root;
+		root.x = Vector(0.5);
+		root.index = R;
+		root.converged = false;
+
+		for (unsigned it = 0; it < n_iter; ++it)
+		{
+			Vector gx(0.0);
+			System::mVector<double, R * (R + 1) / 2> hx(0.0);
+			for (unsigned c = 0; c < (1U << R); ++c)
+			{
+				double w = 1;
+				for (unsigned k = 0; k < R; ++k)
+					w *= ((c >> k) & 1 ? root.x[k] : 1 - root.x[k]);
+				gx += g[c] * w;
+				hx += h[c] * w;
+			}
+
+			double L[R][R], D[R];
+			bool singular = false;
+			for (unsigned j = 0; j < R; ++j)
+			{
+				D[j] = hx[j * (j + 1) / 2 + j];
+				for (unsigned k = 0; k < j; ++k)
+					D[j] -= L[j][k] * L[j][k] * D[k];
+
+				if (D[j] == 0) { singular = true; break; }
+
+				for (unsigned i = j + 1; i < R; ++i)
+				{
+					L[i][j] = hx[i * (i + 1) / 2 + j];
+					for (unsigned k = 0; k < j; ++k)
+						L[i][j] -= L[i][k] * L[j][k] * D[k];
+					L[i][j] /= D[j];
+				}
+			}
+
+			if (singular) return root;
+
+			root.index = 0;
+			for (unsigned j = 0; j < R; ++j)
+				if (D[j] < 0) ++root.index;
+
+			// solve L D L^T dx = -g
+			Vector dx;
+			for (unsigned i = 0; i < R; ++i)
+			{
+				dx[i] = -gx[i];
+				for (unsigned k = 0; k < i; ++k)
+					dx[i] -= L[i][k] * dx[k];
+			}
+			for (unsigned i = 0; i < R; ++i)
+				dx[i] /= D[i];
+			for (unsigned i = R; i-- > 0; )
+				for (unsigned k = i + 1; k < R; ++k)
+					dx[i] -= L[k][i] * dx[k];
+
+			// keep large steps within reach of the cell.
+			double m = 0;
+			for (unsigned k = 0; k < R; ++k)
+				m = std::max(m, std::abs(dx[k]));
+			if (m > 1) dx = dx / m;
+
+			root.x += dx;
+
+			if (m < 1e-10)
+			{
+				root.converged = true;
+				for (unsigned k = 0; k < R; ++k)
+					if (root.x[k] < -1e-6 or root.x[k] > 1 + 1e-6)
+						root.converged = false;
+				return root;
+			}
+		}
+
+		return root;
+	}
+
+	// the Hessian at grid point i, in grid units.
+	template <unsigned R>
+	System::mVector<double, R * (R + 1) / 2> hessian_at(
+		DMT::HessianBase<R> const &H, double scale2, size_t i)
+	{
+		System::mVector<double, R * (R + 1) / 2> h;
+		for (unsigned o = 0; o < R * (R + 1) / 2; ++o)
+			h[o] = H[o][i] / scale2;
+		return h;
+	}
+
 	template <unsigned R>
 	class Gradient
 	{
 		typedef System::mVector<double, R> Vector;
 
-		System::Array<double> data;
+		System::MappedArray<double> data;
 		System::ptr<System::cVector<R>> b;
 
 		public:
 			typedef Vector value_type;
 
-			Gradient(System::ptr<System::BoxConfig<R>> box_, System::Array<double> data_):
+			Gradient(System::ptr<System::BoxConfig<R>> box_, System::MappedArray<double> data_):
 				data(data_), b(new System::cVector<R>(box_->bits())) {}
 
 			inline double fdi(size_t i, unsigned k) const
@@ -58,9 +184,22 @@ namespace Misc
 				return false;
 			}
 
-			Vector find_root(size_t i) const
+			// refines the root within cell i, given the Hessian
+			// of the data on a box with the given scale2.
+			Root<R> find_root(size_t i, DMT::HessianBase<R> const &H, double scale2) const
 			{
-				return Vector();
+				Vector g[1 << R];
+				System::mVector<double, R * (R + 1) / 2> h[1 << R];
+				for (unsigned c = 0; c < (1U << R); ++c)
+				{
+					size_t j = b->add(i, b->sq_i[c]);
+					g[c] = grad(j);
+					h[c] = hessian_at<R>(H, scale2, j);
+				}
+
+				Root<R> root = newton_in_cell<R>(g, h);
+				root.x += b->dvec(i);
+				return root;
 			}
 
 			Vector operator[](size_t i) const
@@ -68,5 +207,175 @@ namespace Misc
 				return grad(i);
 			}
 	};
-}
 
+	/*!
+	 * The same fourth order gradient as Gradient, computed once for the
+	 * whole grid. Components are stored as separate arrays, together
+	 * with the sign of each component, packed two bits per axis. The
+	 * test for a root within a cell then only reads the signs of the
+	 * corners, instead of recomputing the gradient 2^R times per point.
+	 */
+	template <unsigned R>
+	class GradientField
+	{
+		typedef System::mVector<double, R> Vector;
+
+		System::cVector<R>		b;
+		System::Array<double>		g[R];
+		System::Array<uint8_t>		sign;
+						// bit 2k: component k > 0,
+						// bit 2k+1: component k < 0
+
+		typedef System::mVector<double, R * (R + 1) / 2> HVector;
+
+		// Newton iteration in each of the cells, given the Hessian at
+		// their corners, 2^R entries per cell.
+		std::vector<Root<R>> refine(std::vector<size_t> const &cells,
+			std::vector<HVector> const &hc) const
+		{
+			std::vector<Root<R>> result(cells.size());
+
+			#pragma omp parallel for schedule(dynamic, 64)
+			for (size_t n = 0; n < cells.size(); ++n)
+			{
+				Vector gc[1 << R];
+				for (unsigned c = 0; c < (1U << R); ++c)
+					gc[c] = (*this)[b.add(cells[n], b.sq_i[c])];
+
+				result[n] = newton_in_cell<R>(gc, &hc[n << R]);
+				result[n].x += b.dvec(cells[n]);
+			}
+
+			return result;
+		}
+
+		// true if every component changes sign over the corners
+		static bool sign_change(System::Stencil<uint8_t, R> const &s)
+		{
+			uint8_t any = 0;
+			for (unsigned c = 0; c < (1U << R); ++c)
+			{
+				std::ptrdiff_t o = 0;
+				for (unsigned k = 0; k < R; ++k)
+					if ((c >> k) & 1) o += s.stride(k);
+				any |= s[o];
+			}
+
+			for (unsigned k = 0; k < R; ++k)
+				if (((any >> (2 * k)) & 3) != 3) return false;
+			return true;
+		}
+
+		public:
+			typedef Vector value_type;
+
+			GradientField(System::ptr<System::BoxConfig<R>> box_, System::MappedArray<double> data):
+				b(box_->bits()), sign(b.size())
+			{
+				for (unsigned k = 0; k < R; ++k)
+					g[k] = System::Array<double>(b.size());
+
+				System::Tiling<R> tile(b, 2);
+				System::for_each_stencil(tile, data, [this] (System::Stencil<double, R> const &s)
+				{
+					size_t i = s.index();
+					uint8_t sg = 0;
+
+					for (unsigned k = 0; k < R; ++k)
+					{
+						double v = s(k, -2) / 12. - 2. * s(k, -1) / 3.
+							+ 2. * s(k, 1) / 3. - s(k, 2) / 12.;
+						g[k][i] = v;
+						sg |= (v > 0. ? 1 : 0) << (2 * k);
+						sg |= (v < 0. ? 2 : 0) << (2 * k);
+					}
+
+					sign[i] = sg;
+				});
+			}
+
+			System::Array<double> component(unsigned k) const
+			{
+				return g[k];
+			}
+
+			Vector operator[](size_t i) const
+			{
+				Vector v;
+				for (unsigned k = 0; k < R; ++k)
+					v[k] = g[k][i];
+				return v;
+			}
+
+			// the cells (indexed by their lowest corner) in which
+			// all components of the gradient change sign; these are
+			// the cells that may contain a root.
+			std::vector<size_t> root_candidates() const
+			{
+				// each cell marks its own flag, so the threads of
+				// the stencil loop need no lock; collecting the
+				// flags afterwards gives the cells in order.
+				std::vector<uint8_t> flag(b.size(), 0);
+				System::Tiling<R> tile(b, 1);
+
+				System::for_each_stencil(tile, sign, [&flag] (System::Stencil<uint8_t, R> const &s)
+				{
+					flag[s.index()] = sign_change(s);
+				});
+
+				std::vector<size_t> result;
+				for (size_t i = 0; i < flag.size(); ++i)
+					if (flag[i]) result.push_back(i);
+
+				return result;
+			}
+
+			// refines the roots within the given cells, in parallel;
+			// H is the Hessian of the data on a box with the given
+			// scale2. Positions are in grid units.
+			std::vector<Root<R>> find_roots(std::vector<size_t> const &cells,
+				DMT::HessianBase<R> const &H, double scale2) const
+			{
+				std::vector<HVector> hc(cells.size() << R);
+
+				#pragma omp parallel for
+				for (size_t n = 0; n < cells.size(); ++n)
+					for (unsigned c = 0; c < (1U << R); ++c)
+						hc[(n << R) + c] = hessian_at<R>(H, scale2,
+							b.add(cells[n], b.sq_i[c]));
+
+				return refine(cells, hc);
+			}
+
+			// the same, with the Hessian computed a pair of components
+			// at a time and only kept at the corners of the cells, so
+			// that no full Hessian is ever stored.
+			std::vector<Root<R>> find_roots(std::vector<size_t> const &cells,
+				DMT::HessianStream<R> &H, double scale2) const
+			{
+				std::vector<HVector> hc(cells.size() << R);
+
+				for (unsigned o = 0; o < DMT::HessianStream<R>::n_components; ++o)
+				{
+					if (o % 2 == 0) H.compute(o);
+
+					#pragma omp parallel for
+					for (size_t n = 0; n < cells.size(); ++n)
+						for (unsigned c = 0; c < (1U << R); ++c)
+							hc[(n << R) + c][o] = H(o, b.add(cells[n], b.sq_i[c])) / scale2;
+				}
+
+				return refine(cells, hc);
+			}
+
+			// the cells c, as grid positions, for writing to file.
+			System::Array<System::mVector<int, R>> root_candidate_positions(
+				std::vector<size_t> const &c) const
+			{
+				System::Array<System::mVector<int, R>> x(c.size());
+				for (size_t j = 0; j < c.size(); ++j)
+					x[j] = System::mVector<int, R>(b.dvec(c[j]));
+				return x;
+			}
+	};
+}
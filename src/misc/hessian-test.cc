@@ -0,0 +1,100 @@
+#ifdef UNITTEST
+#include "../base/unittest.hh"
+#include "../base/system.hh"
+#include "hessian.hh"
+#include <iostream>
+#include <random>
+
+using namespace System;
+
+Test::Unit Hessian_test("0025 - hessian",
+	"The Hessian of a sum of plane waves follows from multiplying each "
+	"mode with -sin k_i sin k_j. Streamed components should equal the "
+	"stored ones, and the eigenvalue fields should match the "
+	"eigenvalues of the stored Hessian.",
+	[] ()
+{
+	unsigned bits = 4, N = 1 << bits;
+	auto box = make_ptr<BoxConfig<3>>(bits, 32.0);
+	double c = 2 * M_PI / N;
+
+	// a few modes, with wave vectors in grid units.
+	std::vector<mVector<double, 3>> k = {
+		mVector<double, 3>({c, 0, 0}), mVector<double, 3>({0, 2 * c, c}),
+		mVector<double, 3>({c, -c, 3 * c}) };
+	std::vector<double> a = { 1.0, 0.5, 0.25 }, phase = { 0.1, 0.7, 1.3 };
+
+	Array<double> f(box->size());
+	for (size_t i = 0; i < box->size(); ++i)
+	{
+		mVector<double, 3> x = box->box().dvec(i);
+		f[i] = 0;
+		for (unsigned m = 0; m < k.size(); ++m)
+			f[i] += a[m] * cos(k[m].dot(x) + phase[m]);
+	}
+
+	DMT::Hessian<3> H(box, f);
+
+	double err = 0;
+	for (size_t i = 0; i < box->size(); ++i)
+	{
+		mVector<double, 3> x = box->box().dvec(i);
+		for (unsigned o = 0; o < 6; ++o)
+		{
+			unsigned p = DMT::HessianStream<3>::row(o), q = DMT::HessianStream<3>::col(o);
+			double h = 0;
+			for (unsigned m = 0; m < k.size(); ++m)
+				h -= a[m] * sin(k[m][p]) * sin(k[m][q]) * cos(k[m].dot(x) + phase[m]);
+			err = std::max(err, fabs(H[o][i] - h * box->scale2()));
+		}
+	}
+
+	DMT::HessianStream<3> S(box, f);
+	S.stream([&] (unsigned o, Array<double> comp)
+	{
+		for (size_t i = 0; i < box->size(); ++i)
+			if (comp[i] != H[o][i])
+				throw "streamed Hessian component differs from the stored one.";
+	});
+
+	auto ev = DMT::hessian_eigenvalues<3>(box, f);
+	double ev_err = 0;
+	for (size_t i = 0; i < box->size(); ++i)
+	{
+		double h[6], e[3];
+		for (unsigned o = 0; o < 6; ++o) h[o] = H[o][i];
+		DMT::symmetric_eigenvalues(h, e, 3);
+		for (unsigned j = 0; j < 3; ++j)
+			ev_err = std::max(ev_err, fabs(ev[j][i] - e[j]) / (1 + fabs(e[j])));
+
+		if (ev[0][i] > ev[1][i] or ev[1][i] > ev[2][i])
+			throw "eigenvalues are not in ascending order.";
+	}
+
+	// the eigen solver on random matrices: eigenvalues are the roots
+	// of the characteristic polynomial.
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<double> U(-1, 1);
+	for (unsigned t = 0; t < 1000; ++t)
+	{
+		double h[6], e[3];
+		for (double &v : h) v = U(gen);
+		if (t % 10 == 0) h[1] = h[3] = h[4] = 0;
+		DMT::symmetric_eigenvalues(h, e, 3);
+
+		for (unsigned j = 0; j < 3; ++j)
+		{
+			double a00 = h[0] - e[j], a11 = h[2] - e[j], a22 = h[5] - e[j];
+			double det = a00 * (a11 * a22 - h[4] * h[4])
+			           - h[1] * (h[1] * a22 - h[4] * h[3])
+			           + h[3] * (h[1] * h[4] - a11 * h[3]);
+			if (fabs(det) > 1e-10)
+				throw "eigenvalue is not a root of the characteristic polynomial.";
+		}
+	}
+
+	std::cerr << "max error, hessian: " << err << ", eigenvalues: " << ev_err << std::endl;
+	return err < 1e-10 and ev_err < 1e-6;
+});
+
+#endif
@@ -1,56 +1,143 @@
 #pragma once
 
 #include <vector>
+#include <cmath>
 #include "../base/misc.hh"
 #include "../base/array.hh"
 #include "../base/fourier.hh"
 #include "../base/fft.hh"
+#include "../base/boxconfig.hh"
+#include "../base/mmap.hh"
 
 namespace DMT {
 	using System::Array;
+	using System::MappedArray;
 	using System::copy;
 	using System::BoxConfig;
 	using System::ptr;
 	using System::complex64;
 
+	/*!
+	 * Computes the components of the Hessian one pair at a time, using
+	 * a single in-place transform buffer. Both components of a pair are
+	 * real, so they come out of one backward transform as the real and
+	 * imaginary part. The forward transform of the source is redone for
+	 * each pair instead of being kept, so that besides the source only
+	 * the buffer is held: about two full fields. In three dimensions this
+	 * takes six transforms, one fewer than keeping the spectrum and
+	 * transforming back once per component.
+	 *
+	 * Components are numbered as the lower triangle by rows: (0,0),
+	 * (1,0), (1,1), (2,0), (2,1), (2,2).
+	 */
+	template <unsigned R>
+	class HessianStream
+	{
+		ptr<BoxConfig<R>>	box;
+		MappedArray<double>	A;
+		Fourier::Transform	dft;
+		unsigned		current;
+		double			s;
+
+		public:
+			enum { n_components = R * (R + 1) / 2 };
+
+			HessianStream(ptr<BoxConfig<R>> box_, MappedArray<double> A_):
+				box(box_), A(A_), dft(box_->shape(), true),
+				current(n_components), s(box_->scale2() / box_->size()) {}
+
+			static unsigned row(unsigned o)
+			{ unsigned i = 0; while ((i + 1) * (i + 2) / 2 <= o) ++i; return i; }
+
+			static unsigned col(unsigned o)
+			{ return o - row(o) * (row(o) + 1) / 2; }
+
+			// computes the components o and o + 1 (if there is one)
+			// into the buffer; they are read with operator().
+			void compute(unsigned o)
+			{
+				size_t n = box->size();
+				bool two = (o + 1 < n_components);
+				auto K = Fourier::kspace<R>(box->N(), box->N());
+
+				auto F1 = Fourier::Fourier<R>::derivative(row(o))
+				        * Fourier::Fourier<R>::derivative(col(o));
+				auto F2 = (two ? Fourier::Fourier<R>::derivative(row(o + 1))
+				               * Fourier::Fourier<R>::derivative(col(o + 1))
+				               : F1);
+
+				copy(A, dft.in);
+				dft.forward();
+
+				#pragma omp parallel for
+				for (size_t i = 0; i < n; ++i)
+				{
+					auto k = K[i];
+					complex64 f = F1(k);
+					if (two) f += Fourier::math_i * F2(k);
+					dft.in[i] *= f;
+				}
+
+				dft.backward();
+				current = o;
+			}
+
+			// value of component p at grid point i, where p is one
+			// of the two components last computed.
+			double operator()(unsigned p, size_t i) const
+			{
+				return (p == current ? dft.out[i].real() : dft.out[i].imag()) * s;
+			}
+
+			// calls fn(o, component) for each component in turn; the
+			// component is held in a single array, reused between calls.
+			template <typename Consumer>
+			void stream(Consumer fn)
+			{
+				size_t n = box->size();
+				Array<double> c(n);
+
+				for (unsigned o = 0; o < n_components; ++o)
+				{
+					if (o % 2 == 0) compute(o);
+
+					#pragma omp parallel for
+					for (size_t i = 0; i < n; ++i)
+						c[i] = (*this)(o, i);
+
+					fn(o, c);
+				}
+			}
+	};
+
 	template <unsigned R>
 	class HessianBase: public Array<Array<double>>
 	{
 		// std::vector<Array<double>> data;
 
 		public:
-			HessianBase(ptr<BoxConfig<R>> box, Array<double> A);
+			HessianBase(ptr<BoxConfig<R>> box, MappedArray<double> A);
 
 			// Array<double> operator[](unsigned i) const { return data[i]; }
 	};
 
 	template <unsigned R>
-	HessianBase<R>::HessianBase(ptr<BoxConfig<R>> box, Array<double> A):
+	HessianBase<R>::HessianBase(ptr<BoxConfig<R>> box, MappedArray<double> A):
 		Array<Array<double>>(0,0)
 	{
 		for (unsigned i = 0; i < (R * (R + 1))/2; ++i)
 			get()->push_back(Array<double>(box->size()));
 
-		Fourier::Transform dft(box->shape());
-		Array<complex64> A_f(box->size());
-		copy(A, dft.in);
-		dft.forward();
-		copy(dft.out, A_f);
-
-		auto K = Fourier::kspace<R>(box->N(), box->N());
-		unsigned o = 0;
-		double s = box->size() / box->scale2();	
-		for (unsigned i = 0; i < R; ++i) {
-			for (unsigned j = 0; j <= i; ++j)
+		HessianStream<R> H(box, A);
+		for (unsigned o = 0; o < (R * (R + 1))/2; ++o)
 		{
-			//push_back(Array<double>(box->size()));
-			auto F = Fourier::Fourier<R>::derivative(i) 
-			       * Fourier::Fourier<R>::derivative(j);
-			transform(A_f, K, dft.in, Fourier::Fourier<R>::filter(F));
-			dft.backward();
-			transform(dft.out, (*this)[o], Fourier::real_part(s));
-			++o;
-		} }
+			if (o % 2 == 0) H.compute(o);
+
+			Array<double> c = (*this)[o];
+			#pragma omp parallel for
+			for (size_t i = 0; i < box->size(); ++i)
+				c[i] = H(o, i);
+		}
 	}
 
 	template <unsigned R>
@@ -62,5 +149,102 @@ namespace DMT {
 		public:
 			using HessianBase::HessianBase;
 	};
-}
 
+	template <>
+	class Hessian<3>: public HessianBase<3>
+	{
+		public:
+			using HessianBase::HessianBase;
+	};
+
+	// eigenvalues of a symmetric matrix given as its lower triangle,
+	// in ascending order. The 3x3 case uses the trigonometric solution
+	// of the characteristic polynomial (Smith 1961), without branches,
+	// so that the loop over grid points can be vectorised.
+	inline void symmetric_eigenvalues(double const *h, double *e, unsigned R)
+	{
+		if (R == 2)
+		{
+			double m = (h[0] + h[2]) / 2, d = (h[0] - h[2]) / 2,
+			       r = std::sqrt(d * d + h[1] * h[1]);
+			e[0] = m - r; e[1] = m + r;
+			return;
+		}
+
+		double a00 = h[0], a10 = h[1], a11 = h[2],
+		       a20 = h[3], a21 = h[4], a22 = h[5];
+
+		double q = (a00 + a11 + a22) / 3,
+		       p1 = a10 * a10 + a20 * a20 + a21 * a21,
+		       b00 = a00 - q, b11 = a11 - q, b22 = a22 - q,
+		       p2 = b00 * b00 + b11 * b11 + b22 * b22 + 2 * p1,
+		       p = std::sqrt(p2 / 6);
+
+		double det = b00 * (b11 * b22 - a21 * a21)
+		           - a10 * (a10 * b22 - a21 * a20)
+		           + a20 * (a10 * a21 - b11 * a20);
+
+		double ps = (p > 0 ? p : 1),
+		       r = std::min(1.0, std::max(-1.0, det / (2 * ps * ps * ps))),
+		       phi = std::acos(r) / 3;
+
+		e[2] = q + 2 * p * std::cos(phi);
+		e[0] = q + 2 * p * std::cos(phi + 2 * M_PI / 3);
+		e[1] = 3 * q - e[0] - e[2];
+	}
+
+	/*!
+	 * The R eigenvalue fields of the Hessian, in ascending order and in
+	 * single precision, without keeping the full Hessian: the components
+	 * are stored as floats while they are produced, and overwritten by
+	 * the eigenvalues once the transforms are done.
+	 */
+	template <unsigned R>
+	std::vector<Array<float>> hessian_eigenvalues(ptr<BoxConfig<R>> box, MappedArray<double> A)
+	{
+		enum { n = R * (R + 1) / 2 };
+		std::vector<Array<float>> c;
+		for (unsigned o = 0; o < n; ++o)
+			c.push_back(Array<float>(box->size()));
+
+		{
+			HessianStream<R> H(box, A);
+			for (unsigned o = 0; o < n; ++o)
+			{
+				if (o % 2 == 0) H.compute(o);
+
+				Array<float> co = c[o];
+				#pragma omp parallel for
+				for (size_t i = 0; i < box->size(); ++i)
+					co[i] = H(o, i);
+			}
+		}
+
+		size_t m = box->size();
+		#pragma omp parallel for simd
+		for (size_t i = 0; i < m; ++i)
+		{
+			double h[n], e[R];
+			for (unsigned o = 0; o < n; ++o) h[o] = c[o][i];
+			symmetric_eigenvalues(h, e, R);
+			for (unsigned k = 0; k < R; ++k) c[k][i] = e[k];
+		}
+
+		c.resize(R);
+		return c;
+	}
+
+	// writes each component of the Hessian as a record named
+	// hessian-ij, as soon as it is computed; fo is a std::ostream
+	// or an HDF5File.
+	template <unsigned R, typename Output>
+	void write_hessian(Output &fo, ptr<BoxConfig<R>> box, MappedArray<double> A)
+	{
+		HessianStream<R> H(box, A);
+		H.stream([&fo] (unsigned o, Array<double> c)
+		{
+			save_to_file(fo, c, Misc::format("hessian-",
+				HessianStream<R>::row(o), HessianStream<R>::col(o)));
+		});
+	}
+}
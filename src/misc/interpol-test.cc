@@ -0,0 +1,131 @@
+#ifdef UNITTEST
+#include "../base/unittest.hh"
+#include "../base/system.hh"
+#include "../glass/distances.hh"
+#include "interpol.hh"
+#include <iostream>
+
+using namespace System;
+
+Test::Unit Interpol_CIC_test("0021 - cloud-in-cell",
+	"The batch linear interpolation should reproduce grid values at "
+	"grid points, agree with the point-wise interpolation, and be "
+	"the adjoint of cloud-in-cell mass assignment.",
+	[] ()
+{
+	typedef mVector<double, 3> Point;
+
+	auto box = make_ptr<Box<3>>(16, 32.0);
+	Array<double> f(box->size());
+	for (size_t i = 0; i < box->size(); ++i)
+	{
+		Point x = box->G[i];
+		f[i] = sin(2 * M_PI * x[0] / 32.0) * cos(4 * M_PI * x[2] / 32.0) + x[1] / 32.0;
+	}
+
+	Misc::Interpol::Linear<Array<double>, 3> pot(box, f);
+
+	Array<Point> G(box->size());
+	for (size_t i = 0; i < box->size(); ++i)
+		G[i] = box->G[i];
+
+	Array<double> g = pot.sample(G, box->scale());
+	for (size_t i = 0; i < box->size(); ++i)
+		if (fabs(g[i] - f[i]) > 1e-12)
+			throw "interpolation at grid points does not match grid values.";
+
+	Array<Point> X(10000);
+	generate(X, Glass::random_uniform_particles<3>(0, 32.0));
+	Array<double> y = pot.sample(X, box->scale());
+	for (size_t p = 0; p < X.size(); ++p)
+		if (fabs(y[p] - pot(X[p] / box->scale())) > 1e-12)
+			throw "batch interpolation differs from point-wise interpolation.";
+
+	Array<double> rho(box->size(), 0.0);
+	Misc::Interpol::deposit(*box, X, rho, box->scale());
+
+	double mass = 0, lhs = 0, rhs = 0;
+	for (size_t i = 0; i < box->size(); ++i)
+	{
+		mass += rho[i];
+		rhs += rho[i] * f[i];
+	}
+	for (size_t p = 0; p < X.size(); ++p)
+		lhs += y[p];
+
+	std::cerr << "deposited mass: " << mass << ", <f, rho> = " << rhs
+		<< ", sum f(x) = " << lhs << std::endl;
+
+	return fabs(mass - X.size()) < 1e-6 and fabs(lhs - rhs) < 1e-6;
+});
+
+Test::Unit Interpol_spline_test("0022 - spline",
+	"The tricubic spline should go through the grid values, be more "
+	"accurate than linear interpolation on a smooth field, and give "
+	"the same answer from its caches as without them.",
+	[] ()
+{
+	typedef mVector<double, 3> Point;
+
+	auto box = make_ptr<Box<3>>(16, 16.0);
+	auto fn = [] (Point const &x)
+	{
+		return sin(2 * M_PI * x[0] / 16.0) * cos(2 * M_PI * x[1] / 16.0)
+			+ sin(4 * M_PI * x[2] / 16.0);
+	};
+
+	Array<double> f(box->size());
+	for (size_t i = 0; i < box->size(); ++i)
+		f[i] = fn(box->G[i]);
+
+	Misc::Interpol::Spline<Array<double>, 3> spline(box, f);
+	Misc::Interpol::Linear<Array<double>, 3> linear(box, f);
+
+	for (size_t i = 0; i < box->size(); i += 7)
+		if (fabs(spline(box->G[i]) - f[i]) > 1e-12)
+			throw "spline does not go through the grid values.";
+
+	Array<Point> X(20000);
+	generate(X, Glass::random_uniform_particles<3>(1, 16.0));
+	Array<double> y = spline.sample(X);
+	Array<mVector<double, 3>> g = spline.sample_gradient(X);
+
+	// sampling from inside an outer parallel region, where nested
+	// threads all have thread number 0, must not share a cache.
+	bool nested_ok = true;
+	#pragma omp parallel for schedule(static, 1)
+	for (unsigned i = 0; i < 8; ++i)
+	{
+		Array<Point> Y(2000);
+		std::copy(X.begin() + 2000 * i, X.begin() + 2000 * (i + 1), Y.begin());
+		Array<double> z = spline.sample(Y);
+		for (size_t p = 0; p < Y.size(); ++p)
+			if (z[p] != y[2000 * i + p])
+				nested_ok = false;
+	}
+	if (not nested_ok)
+		throw "spline sampled inside a parallel region differs.";
+
+	double err_spline = 0, err_linear = 0;
+	for (size_t p = 0; p < X.size(); ++p)
+	{
+		if (fabs(y[p] - spline(X[p])) > 1e-12)
+			throw "cached spline coefficients differ from fresh ones.";
+
+		double h = 1e-5;
+		Point dx(0.0); dx[1] = h;
+		double d = (spline(X[p] + dx) - spline(X[p] - dx)) / (2 * h);
+		if (fabs(d - g[p][1]) > 1e-5)
+			throw "spline gradient does not match finite difference.";
+
+		err_spline = std::max(err_spline, fabs(y[p] - fn(X[p])));
+		err_linear = std::max(err_linear, fabs(linear(X[p]) - fn(X[p])));
+	}
+
+	std::cerr << "max error, spline: " << err_spline
+		<< ", linear: " << err_linear << std::endl;
+
+	return err_spline < err_linear / 4;
+});
+
+#endif
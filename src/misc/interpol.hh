@@ -1,6 +1,7 @@
 #pragma once
 #include "base/system.hh"
-#include <queue>
+#include <cmath>
+#include <vector>
 
 namespace Misc
 {
@@ -9,165 +10,390 @@ namespace Misc
 	using System::cVector;
 	using System::mVector;
 
-	template <typename Q, unsigned R>
-	class Linear
+	/*!
+	 * Cloud-in-cell (trilinear) weights on a periodic grid with
+	 * N = 2^b points on a side. Periodic wrapping is done by masking
+	 * with N-1, and the strides are precomputed, so finding the 2^R
+	 * corners of a cell costs no integer divisions. The same weights
+	 * serve interpolation (gather) and mass assignment (scatter).
+	 */
+	template <unsigned R>
+	class CloudInCell
 	{
-		using dVector = System::mVector<double, R>;
-		using iVector = System::mVector<int, R>;
-
-		System::ptr<System::Box<R>> 	box;
-		Q				f;
+		unsigned	mask;
+		size_t		stride[R];
 
 		public:
-			//typedef typename Q::value_type FT;
+			enum { corners = 1 << R };
 			typedef mVector<double, R> Point;
 
-			Linear(System::ptr<System::Box<R>> box_, Q f_):
-				box(box_), f(f_)
-			{}
+			CloudInCell(System::Box<R> const &box):
+				mask(box.N() - 1)
+			{
+				if ((box.N() & mask) != 0)
+					throw "cloud-in-cell kernel needs a grid size that is a power of two.";
 
-			typename Q::value_type operator()(Point const &x) const
+				stride[0] = 1;
+				for (unsigned k = 1; k < R; ++k)
+					stride[k] = stride[k-1] * box.N();
+			}
+
+			// x is given in grid units; computes the flat indices and
+			// weights of the 2^R corners of the cell containing x.
+			void operator()(Point const &x, size_t *idx, double *w) const
 			{
-				iVector origin;
-				dVector A[2];
-				//double r = box->scale();
+				int    o[R];
+				double a[R];
 
 				for (unsigned k = 0; k < R; ++k)
 				{
-					origin[k] = (int)(x[k]);
-					A[1][k] = x[k] - origin[k];
-					A[0][k] = 1 - A[1][k];
+					double f = std::floor(x[k]);
+					o[k] = static_cast<int>(f);
+					a[k] = x[k] - f;
 				}
 
-				// size_t s = box->idx(origin);
-				typename Q::value_type v(0);
-
-				for (unsigned i = 0; i < (1 << R); ++i)
+				for (unsigned i = 0; i < corners; ++i)
 				{
+					size_t n = 0;
 					double z = 1;
 					for (unsigned k = 0; k < R; ++k)
-						z *= A[box->block[i][k]][k];
+					{
+						unsigned b = (i >> k) & 1U;
+						n += ((o[k] + b) & mask) * stride[k];
+						z *= (b ? a[k] : 1 - a[k]);
+					}
 
-					v += f[box->idx(origin + box->block[i])] * z;
+					idx[i] = n;
+					w[i] = z;
 				}
-
-				return v;
 			}
 	};
-/*
-	template <typename F, int R>
-	class Spline {};
 
-	template <typename F>
-	class Spline<F, 1>
+	template <typename Q, unsigned R>
+	class Linear
 	{
-		cVector<2>	loop;
-		enum { R = 1 };
-		cVector<1>	box;
-
-		static double	A[16];
-		F		fd;
-
-		typedef mVector<double, R> 	fVector;
-		typedef mVector<int, R> 	iVector;
+		System::ptr<System::Box<R>> 	box;
+		Q				f;
+		CloudInCell<R>			cic;
 
 		public:
-			Spline(unsigned bits_, F const &f_):
-				loop(2),
-				box(bits_), fd(f_)
+			typedef typename Q::value_type value_type;
+			typedef mVector<double, R> Point;
+
+			Linear(System::ptr<System::Box<R>> box_, Q f_):
+				box(box_), f(f_), cic(*box_)
 			{}
 
-			double operator()(fVector const &x)
+			// x is given in grid units
+			value_type operator()(Point const &x) const
 			{
-				return f(x);
+				size_t idx[CloudInCell<R>::corners];
+				double w[CloudInCell<R>::corners];
+				cic(x, idx, w);
+
+				value_type v(0);
+				for (unsigned i = 0; i < CloudInCell<R>::corners; ++i)
+					v += f[idx[i]] * w[i];
+
+				return v;
 			}
 
-			double f(fVector const &x);
-			double df(unsigned k, fVector const &x);
+			// interpolates at all positions in X at once; the
+			// coordinates are divided by unit to get grid units.
+			System::Array<value_type> sample(
+				System::Array<Point> const &X, double unit = 1.0) const
+			{
+				System::Array<value_type> result(X.size());
+				size_t M = X.size();
+				double s = 1.0 / unit;
+
+				#pragma omp parallel for schedule(static)
+				for (size_t p = 0; p < M; ++p)
+					result[p] = (*this)(X[p] * s);
+
+				return result;
+			}
 	};
 
-	template <typename T>
-	class Cache
+	/*!
+	 * Cloud-in-cell mass assignment, the adjoint of Linear::sample.
+	 * Adds mass for each particle in X to rho; the coordinates
+	 * are divided by unit to get grid units.
+	 */
+	template <unsigned R>
+	void deposit(System::Box<R> const &box,
+		System::Array<mVector<double, R>> const &X,
+		System::Array<double> rho, double unit = 1.0, double mass = 1.0)
 	{
-		std::queue<size_t> history;
-		std::map<size_t, T> data;
+		CloudInCell<R> cic(box);
+		double *target = rho.get()->data();
+		size_t M = X.size();
+		double s = 1.0 / unit;
+
+		#pragma omp parallel for schedule(static)
+		for (size_t p = 0; p < M; ++p)
+		{
+			size_t idx[CloudInCell<R>::corners];
+			double w[CloudInCell<R>::corners];
+			cic(X[p] * s, idx, w);
+
+			for (unsigned i = 0; i < CloudInCell<R>::corners; ++i)
+			{
+				#pragma omp atomic
+				target[idx[i]] += mass * w[i];
+			}
+		}
+	}
+	/*!
+	 * Bicubic or tricubic spline interpolation on a periodic grid with
+	 * N = 2^b points on a side. The spline is the tensor product of 1D
+	 * Catmull-Rom splines, which is the Hermite spline with (cross-)
+	 * derivatives taken from central differences. Polynomial coefficients
+	 * are computed once per cell and kept in a direct-mapped Cache owned
+	 * by the caller; sample() gives every thread of its loop its own, so
+	 * lookups need no locking. Calls without a cache compute the
+	 * coefficients afresh.
+	 */
+	template <typename Q, unsigned R>
+	class Spline
+	{
+		public:
+			typedef typename Q::value_type value_type;
+			typedef mVector<double, R> Point;
+
+			enum { n_coef = 1 << (2 * R) };
+
+			struct Slot
+			{
+				size_t		cell;
+				value_type	alpha[n_coef];
+			};
+
+			typedef std::vector<Slot> Cache;
+
+		private:
+			System::ptr<System::Box<R>>	box;
+			Q				f;
+			unsigned			mask;
+			size_t				stride[R], cache_mask;
+
+			void coefficients(int const *o, value_type *alpha) const;
+			value_type const *lookup(Point const &x, double *t,
+				value_type *scratch, Cache *cache) const;
 
 		public:
-			T &operator()(size_t i, std::function<T ()> const &f)
+			Spline(System::ptr<System::Box<R>> box_, Q f_, unsigned cache_bits = 11);
+
+			// an empty cache of the size given to the constructor
+			Cache make_cache() const
+			{
+				Slot empty;
+				empty.cell = ~size_t(0);
+				return Cache(cache_mask + 1, empty);
+			}
+
+			// x is given in grid units
+			value_type operator()(Point const &x, Cache *cache = nullptr) const;
+
+			// derivative in direction k, in grid units
+			value_type df(unsigned k, Point const &x, Cache *cache = nullptr) const;
+
+			mVector<value_type, R> gradient(Point const &x, Cache *cache = nullptr) const
+			{
+				mVector<value_type, R> v;
+				for (unsigned k = 0; k < R; ++k)
+					v[k] = df(k, x, cache);
+				return v;
+			}
+
+			// interpolates at all positions in X at once; the
+			// coordinates are divided by unit to get grid units.
+			System::Array<value_type> sample(
+				System::Array<Point> const &X, double unit = 1.0) const
 			{
-				if (data.count(i) == 0)
+				System::Array<value_type> result(X.size());
+				size_t M = X.size();
+				double s = 1.0 / unit;
+
+				#pragma omp parallel
 				{
-					if (history.size() > 65536)
-					{
-						size_t j = history.front();
-						history.pop();
-						data.erase(j);
-					}
+					Cache cache = make_cache();
 
-					history.push(i);
-					data[i] = f();
+					#pragma omp for schedule(static)
+					for (size_t p = 0; p < M; ++p)
+						result[p] = (*this)(X[p] * s, &cache);
 				}
 
-				return data[i];
+				return result;
 			}
-	};
 
-	template <typename F>
-	class Spline<F, 2>
-	{
-		enum { R = 2 };
-		cVector<2> 	loop;
-		cVector<2> 	b4;
-		cVector<2> 	box;
-		F			fn;
+			// samples the gradient in physical units at all positions in X.
+			System::Array<mVector<value_type, R>> sample_gradient(
+				System::Array<Point> const &X, double unit = 1.0) const
+			{
+				System::Array<mVector<value_type, R>> result(X.size());
+				size_t M = X.size();
+				double s = 1.0 / unit;
 
-		typedef mVector<double, R> 	fVector;
-		typedef mVector<int, R> 	iVector;
+				#pragma omp parallel
+				{
+					Cache cache = make_cache();
 
-		static double				A[256];
-		mutable Cache<std::vector<double>>	cache;
+					#pragma omp for schedule(static)
+					for (size_t p = 0; p < M; ++p)
+						result[p] = gradient(X[p] * s, &cache) * s;
+				}
 
-		public:
-			Spline(unsigned bits, F const &f_);
-			double operator()(fVector const &x) const;
-			double f(fVector const &x) const;
-			double df(unsigned k, fVector const &x) const;
+				return result;
+			}
 	};
 
-	template <typename F>
-	class Spline<F, 3>
+	// Catmull-Rom spline in power basis; rows give the coefficient of
+	// t^n, columns the contribution of the points at -1, 0, 1 and 2.
+	static double const catmull_rom[4][4] = {
+		{  0.0,  1.0,  0.0,  0.0 },
+		{ -0.5,  0.0,  0.5,  0.0 },
+		{  1.0, -2.5,  2.0, -0.5 },
+		{ -0.5,  1.5, -1.5,  0.5 } };
+
+	template <typename Q, unsigned R>
+	Spline<Q, R>::Spline(System::ptr<System::Box<R>> box_, Q f_, unsigned cache_bits):
+		box(box_), f(f_), mask(box_->N() - 1),
+		cache_mask((size_t(1) << cache_bits) - 1)
 	{
-		enum { R = 3 };
+		if ((box->N() & mask) != 0)
+			throw "spline interpolation needs a grid size that is a power of two.";
 
-		cVector<2> 	loop;
-		cVector<R> 	b4;
-		cVector<R> 	box;
-		F		fn;
+		stride[0] = 1;
+		for (unsigned k = 1; k < R; ++k)
+			stride[k] = stride[k-1] * box->N();
+	}
 
-		typedef typename F::value_type value_type;
-		typedef mVector<double, R> 	fVector;
-		typedef mVector<int, R> 	iVector;
+	// Computes the 4^R polynomial coefficients of the cell with origin o.
+	// The coefficient of x^i y^j z^k is stored at i + 4j + 16k.
+	template <typename Q, unsigned R>
+	void Spline<Q, R>::coefficients(int const *o, value_type *alpha) const
+	{
+		for (unsigned i = 0; i < n_coef; ++i)
+		{
+			size_t n = 0;
+			for (unsigned k = 0; k < R; ++k)
+			{
+				int a = (i >> (2 * k)) & 3U;
+				n += ((o[k] - 1 + a) & mask) * stride[k];
+			}
+			alpha[i] = f[n];
+		}
+
+		// the Catmull-Rom matrix is applied separately on each axis
+		value_type tmp[n_coef];
+		for (unsigned k = 0; k < R; ++k)
+		{
+			unsigned s = 1U << (2 * k);
+			for (unsigned i = 0; i < n_coef; ++i)
+			{
+				unsigned p = (i >> (2 * k)) & 3U,
+					 base = i - p * s;
 
-		static double			A[4096];
-		mutable Cache<std::vector<value_type>>	cache;
+				value_type v(0);
+				for (unsigned m = 0; m < 4; ++m)
+					v += alpha[base + m * s] * catmull_rom[p][m];
+				tmp[i] = v;
+			}
+			std::copy(tmp, tmp + n_coef, alpha);
+		}
+	}
 
-		public:
-			Spline(unsigned bits, F const &f_);
-			value_type operator()(fVector const &x) const;
-			value_type f(fVector const &x) const;
-			value_type df(unsigned k, fVector const &x) const;
-	};
+	template <typename Q, unsigned R>
+	typename Spline<Q, R>::value_type const *Spline<Q, R>::lookup(
+		Point const &x, double *t, value_type *scratch, Cache *cache) const
+	{
+		int o[R];
+		size_t c = 0;
+		for (unsigned k = 0; k < R; ++k)
+		{
+			double fl = std::floor(x[k]);
+			o[k] = static_cast<int>(fl) & mask;
+			t[k] = x[k] - fl;
+			c += o[k] * stride[k];
+		}
+
+		if (cache == nullptr)
+		{
+			coefficients(o, scratch);
+			return scratch;
+		}
+
+		Slot &slot = (*cache)[c & cache_mask];
+		if (slot.cell != c)
+		{
+			coefficients(o, slot.alpha);
+			slot.cell = c;
+		}
+
+		return slot.alpha;
+	}
 
-#include "spline1.ih"
-#include "spline2.ih"
-#include "spline3.ih"
-*/
+	template <typename Q, unsigned R>
+	typename Spline<Q, R>::value_type Spline<Q, R>::operator()(
+		Point const &x, Cache *cache) const
+	{
+		double t[R], pw[R][4];
+		value_type scratch[n_coef];
+		value_type const *alpha = lookup(x, t, scratch, cache);
+
+		for (unsigned k = 0; k < R; ++k)
+		{
+			pw[k][0] = 1; pw[k][1] = t[k];
+			pw[k][2] = t[k] * t[k]; pw[k][3] = pw[k][2] * t[k];
+		}
+
+		value_type v(0);
+		for (unsigned i = 0; i < n_coef; ++i)
+		{
+			double z = 1;
+			for (unsigned k = 0; k < R; ++k)
+				z *= pw[k][(i >> (2 * k)) & 3U];
+			v += alpha[i] * z;
+		}
+
+		return v;
+	}
+
+	template <typename Q, unsigned R>
+	typename Spline<Q, R>::value_type Spline<Q, R>::df(
+		unsigned j, Point const &x, Cache *cache) const
+	{
+		double t[R], pw[R][4];
+		value_type scratch[n_coef];
+		value_type const *alpha = lookup(x, t, scratch, cache);
+
+		for (unsigned k = 0; k < R; ++k)
+		{
+			if (k == j)
+			{
+				pw[k][0] = 0; pw[k][1] = 1;
+				pw[k][2] = 2 * t[k]; pw[k][3] = 3 * t[k] * t[k];
+			}
+			else
+			{
+				pw[k][0] = 1; pw[k][1] = t[k];
+				pw[k][2] = t[k] * t[k]; pw[k][3] = pw[k][2] * t[k];
+			}
+		}
+
+		value_type v(0);
+		for (unsigned i = 0; i < n_coef; ++i)
+		{
+			double z = 1;
+			for (unsigned k = 0; k < R; ++k)
+				z *= pw[k][(i >> (2 * k)) & 3U];
+			v += alpha[i] * z;
+		}
+
+		return v;
+	}
 	} // namespace Interpol
 } // namespace Misc
 
-/*
-#include "cspline.ih"
-#include "bspline.ih"
-#include "tspline.ih"
-*/
 // vim:sw=4:ts=4:tw=72
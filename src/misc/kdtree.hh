@@ -1,123 +1,137 @@
 #pragma once
 #include <utility>
-#include <memory>
-#include <functional>
 #include <algorithm>
+#include <vector>
+#include <cstdint>
 
 #include "../base/mvector.hh"
+#include "../base/array.hh"
 
 /*
  * KdTree algorithm
  * To count the number of points that satisfy a certain
- * predicate, you have to define a function object
- * that derives from predicate.
- * This object needs not be constant. So that a comparison
- * with a bounding box can influence the way points within 
- * this box are tested.
+ * predicate, you have to define a function object with
+ * two call operators: one taking a point, and one taking
+ * a BoundingBox, telling whether any point inside the box
+ * could satisfy the predicate. Visitors and distance
+ * measures work the same way. Queries are templates on these
+ * types, so the compiler can inline them; there is no need to
+ * derive from a base class.
+ *
+ * The tree is stored in a single array of nodes in pre-order:
+ * the left child of a node directly follows its parent, the
+ * right child is found by an offset stored in the parent.
+ * Leaves refer to a range in a permutation of indices into the
+ * point set. A copy of the coordinates, sorted in the same order
+ * and stored per axis, lets a kernel run over all points of a
+ * leaf at once. Large subtrees are built in parallel, as OpenMP
+ * tasks; the bounding boxes of the children are found while
+ * partitioning. Points are not reordered, so the layout of the
+ * tree only depends on the positions of the points. When the
+ * points move a little, the tree can be refitted in stead of
+ * rebuilt: bounding boxes are updated bottom-up, and only
+ * subtrees where the children overlap too much are partitioned
+ * anew.
  */
 
 namespace kdTree {
 
-// should change to some different template scheme
-
-template <typename Point, int R>
+template <unsigned R>
 class BoundingBox
 {
-	std::function<double (Point const &, int)> index;
-
 	public:
 		System::mVector<double, R> X1, X2;
-		BoundingBox(std::function<double (Point const &, int)> index_):
-       			index(index_) {}
-
-		BoundingBox(
-			System::mVector<double, R> const &X1_, 
-			System::mVector<double, R> const &X2_,
-			std::function<double (Point const &, int)> index_);
-
-		template <typename Iter>
-		BoundingBox(Iter begin, Iter end,
-			std::function<double (Point const &, int)> index_);
 
 		double max_coord(unsigned i) const { return X2[i]; }
 		double min_coord(unsigned i) const { return X1[i]; }
-		double half(unsigned i);
-};
+		double half(unsigned i) const { return (X2[i] + X1[i]) / 2; }
 
-template <typename Point, int R>
-class Distance
-{
-	public:
-		virtual double operator()(Point const &) const = 0;
-		virtual double operator()(BoundingBox<Point, R> const &) const = 0;
-		virtual ~Distance() {}
-};
+		void fit(BoundingBox const &a, BoundingBox const &b);
+		void clear();
 
-template <typename Point, int R>
-class Predicate
-{
-	public:
-		virtual bool operator()(Point const &) const = 0;
-		virtual bool operator()(BoundingBox<Point, R> const &) const = 0;
-		virtual ~Predicate() {}
+		template <typename Point>
+		void expand(Point const &p);
 };
 
-template <typename Point>
-class Visitor
+template <unsigned R>
+struct Node: public BoundingBox<R>
 {
-	public:
-		virtual void operator()(Point const &) = 0;
-		virtual ~Visitor() {}
+	size_t		begin, end;	// range in the index permutation
+	uint32_t	right;		// offset to the right child, 0 for leaves
+	uint8_t		dim, depth;
+
+	bool is_leaf() const { return right == 0; }
 };
 
-template <typename Point, int R>
-class Branch: public BoundingBox<Point, R>
+template <typename Point, unsigned R>
+class Tree
 {
-	public:
-		Branch() {}
+	enum { leaf_size = 32, max_depth = 128, task_size = 1 << 14 };
 
-		template <typename Iter>
-		Branch(Iter begin, Iter end,
-			std::function<double (Point const &, int)> idx): 
-			BoundingBox<Point, R>(begin, end, idx) {}
+	System::Array<Point>	points;
+	std::vector<size_t>	order;
+	std::vector<Node<R>>	nodes;
+	std::vector<double>	coords;	// R x size(), in the order of the leaves
 
-		virtual size_t count_if(Predicate<Point, R> const &pred) const = 0;
-		virtual ~Branch() {}
-		virtual void traverse(Visitor<Point> &visit, Predicate<Point, R> const &pred) const = 0;
-		virtual Point const &nearest_neighbour(Distance<Point, R> const &dist) const = 0;
-};
+	void update_coordinates();
 
-template <typename Point, int R>
-class Tree: public Branch<Point, R>
-{
-	typedef std::unique_ptr<Branch<Point, R>> Branch_ptr;
-	std::pair<Branch_ptr, Branch_ptr> B;
+	BoundingBox<R> fit(size_t begin, size_t end) const;
+	size_t partition(size_t begin, size_t end, unsigned dim, double boundary,
+		BoundingBox<R> &a, BoundingBox<R> &b);
+	void build(size_t begin, size_t end, BoundingBox<R> const &box,
+		unsigned dim, unsigned depth, std::vector<Node<R>> &out);
+	size_t rewrite(std::vector<Node<R>> const &old, size_t i, double tolerance);
 
-	public:
-		template <typename Iter>
-		Tree(Iter begin, Iter end, 
-			std::function<double (Point const &, int)> idx, 
-			int dim = 0, int depth = 0);
-
-		virtual size_t count_if(Predicate<Point, R> const &pred) const;
-		virtual void traverse(Visitor<Point> &visit, Predicate<Point, R> const &pred) const;
-		virtual Point const &nearest_neighbour(Distance<Point, R> const &dist) const;
-//	private:
-//		Tree(Tree const &); //NI
-};
+	template <typename Dist>
+	void nearest(size_t i, Dist const &dist, size_t &best, double &d) const;
 
-template <typename Point, int R, typename Iter>
-class Leaf: public Branch<Point, R>
-{
-	std::pair<Iter, Iter>	I;
+	template <typename Dist>
+	void nearest_k(size_t i, Dist const &dist, unsigned k,
+		std::vector<std::pair<double, size_t>> &heap) const;
 
 	public:
-		Leaf(Iter begin, Iter end,
-			std::function<double (Point const &, int)> idx);
-
-		virtual size_t count_if(Predicate<Point, R> const &pred) const;
-		virtual void traverse(Visitor<Point> &visit, Predicate<Point, R> const &pred) const;
-		virtual Point const &nearest_neighbour(Distance<Point, R> const &dist) const;
+		// The tree keeps a reference to the point set; after moving
+		// points, call refit() before doing new queries.
+		Tree(System::Array<Point> points_);
+
+		template <typename Pred>
+		size_t count_if(Pred const &pred) const;
+
+		template <typename Visit, typename Pred>
+		void traverse(Visit &visit, Pred const &pred) const;
+
+		// calls kernel(x, n) for each leaf whose box passes the predicate,
+		// where x[k] points to the k-th coordinates of the n points in the
+		// leaf. The points themselves are not tested.
+		template <typename Kernel, typename Pred>
+		void traverse_leaves(Kernel &kernel, Pred const &pred) const;
+
+		// throws on an empty tree.
+		template <typename Dist>
+		Point const &nearest_neighbour(Dist const &dist) const;
+
+		// the k nearest points as (distance, index) pairs, closest first.
+		template <typename Dist>
+		std::vector<std::pair<double, size_t>> nearest_neighbours(
+			Dist const &dist, unsigned k) const;
+
+		// k nearest neighbours for n queries, run in parallel; make_dist(j)
+		// gives the distance measure for query j. The result has k
+		// entries per query, in the order of the queries.
+		template <typename MakeDist>
+		std::vector<std::pair<double, size_t>> nearest_neighbours(
+			size_t n, unsigned k, MakeDist const &make_dist) const;
+
+		// tolerance is the allowed overlap of two sibling nodes along
+		// their splitting axis, relative to the size of the parent.
+		// Returns the number of nodes that were partitioned anew.
+		size_t refit(double tolerance = 0.1);
+
+		BoundingBox<R> const &bounding_box() const
+			{ return nodes[0]; }
+
+		size_t size() const { return order.size(); }
+		size_t n_nodes() const { return nodes.size(); }
 };
 
 } // namespace kdTree
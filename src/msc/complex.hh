@@ -0,0 +1,400 @@
+#pragma once
+#include "msc.hh"
+#include "../base/array.hh"
+#include "support/ply/ply.hh"
+
+#include <vector>
+#include <unordered_map>
+#include <numeric>
+#include <algorithm>
+
+namespace DMT
+{
+	// class Complex {{{1
+	/*
+	 * The one dimensional part of the Morse-Smale complex, computed
+	 * from the discrete gradient of an MSC. The separatrices are the
+	 * V-paths that run from saddles of index 1 down to minima, and
+	 * from saddles of index R-1 up to maxima; each of these is a single
+	 * chain of cells, so they are traced independently over the OpenMP
+	 * threads. In three dimensions the ascending separatrices form the
+	 * filament skeleton.
+	 *
+	 * Persistence pairs of extrema and saddles follow from the elder
+	 * rule: saddles are taken in order of value, and a saddle joining
+	 * two components cancels the younger extremum. Pairs below the
+	 * simplification threshold are removed from the complex, and the
+	 * arcs of the remaining saddles are assigned to the surviving
+	 * extrema. The V-paths are not rerouted through the cancelled
+	 * pairs: the cells of an arc still end on the original extremum,
+	 * which is kept as its end. Only extremum-saddle pairs are
+	 * cancelled; pairs of two saddles are left in the complex.
+	 */
+	template <unsigned R>
+	class Complex
+	{
+		public:
+			struct Arc
+			{
+				size_t			saddle, extremum, end;
+							// indices into critical(); end
+							// is where the cells stop, the
+							// extremum that survives the
+							// simplification may differ
+				bool			ascending;
+				std::vector<size_t>	cells;
+							// the V-path, from the saddle
+							// to end, as indices into the
+							// double box
+			};
+
+			struct Pair
+			{
+				size_t	extremum, saddle;
+				double	persistence;
+			};
+
+		private:
+			MSC<R> const	&msc;
+			cVector<R> const	&box;
+
+			std::vector<size_t>	crit;
+			std::unordered_map<size_t, size_t> crit_index;
+						// position in crit of a cell
+						// in the double box
+			std::vector<Arc>	arcs;
+			std::vector<Pair>	pairs;
+			std::vector<bool>	cancelled;
+			std::vector<size_t>	survivor;
+
+			bool cell_less(size_t a, size_t b) const
+			{
+				return msc.cell_value(a) < msc.cell_value(b) or
+					(msc.cell_value(a) == msc.cell_value(b) and a < b);
+			}
+
+			// the axis along which the cell is odd (odd = true) or
+			// even, where there is only one such axis.
+			unsigned single_axis(size_t i, bool odd) const
+			{
+				for (unsigned k = 0; k < R; ++k)
+					if (((box.i(i, k) % 2) == 1) == odd)
+						return k;
+				return R;
+			}
+
+			// the other facet (or cofacet) of i along the axis k.
+			size_t other(size_t i, unsigned k, size_t from) const
+			{
+				size_t u = box.unit_vector(k),
+				       a = box.add(i, u), b = box.sub(i, u);
+				return (a == from ? b : a);
+			}
+
+			std::vector<size_t> trace(size_t s, size_t f, bool ascending) const;
+			void trace_all();
+			void pair_extrema(bool ascending, double threshold);
+
+		public:
+			Complex(MSC<R> const &msc_, double threshold = 0);
+
+			std::vector<size_t> const &critical() const { return crit; }
+			std::vector<Arc> const &separatrices() const { return arcs; }
+			std::vector<Pair> const &persistence_pairs() const { return pairs; }
+			bool is_cancelled(size_t c) const { return cancelled[c]; }
+
+			// the extremum that represents c after simplification
+			size_t representative(size_t c) const;
+
+			// fo is a std::ostream or an HDF5File
+			template <typename Output>
+			void save(Output &fo) const;
+			void write_ply(std::string const &filename, double L) const;
+	};
+	// }}}1
+
+	// implementation {{{1
+	// constructor {{{2
+	template <unsigned R>
+	Complex<R>::Complex(MSC<R> const &msc_, double threshold):
+		msc(msc_), box(msc_.box()), crit(msc_.critical_cells())
+	{
+		std::sort(crit.begin(), crit.end(),
+			[this] (size_t a, size_t b) { return cell_less(a, b); });
+
+		for (size_t c = 0; c < crit.size(); ++c)
+			crit_index[crit[c]] = c;
+
+		cancelled.assign(crit.size(), false);
+		survivor.resize(crit.size());
+		std::iota(survivor.begin(), survivor.end(), 0);
+
+		trace_all();
+		pair_extrema(false, threshold);
+		pair_extrema(true, threshold);
+
+		std::vector<Arc> kept;
+		for (Arc &a : arcs)
+		{
+			if (cancelled[a.saddle]) continue;
+			a.extremum = representative(a.extremum);
+			kept.push_back(std::move(a));
+		}
+		arcs.swap(kept);
+	}
+	// }}}2
+
+	// Complex::trace {{{2
+	/*
+	 * Follows the V-path from saddle s through its facet (or cofacet)
+	 * f. Each step goes through the cell paired with f, and leaves it
+	 * by its other facet, until a critical cell is reached.
+	 */
+	template <unsigned R>
+	std::vector<size_t> Complex<R>::trace(size_t s, size_t f, bool ascending) const
+	{
+		std::vector<size_t> path(1, s);
+
+		while (true)
+		{
+			path.push_back(f);
+			size_t h = msc.paired_with(f);
+			if (h == f) return path;
+
+			path.push_back(h);
+			f = other(h, single_axis(h, not ascending), f);
+		}
+	}
+	// }}}2
+
+	// Complex::trace_all {{{2
+	template <unsigned R>
+	void Complex<R>::trace_all()
+	{
+		// the saddles with their two directions; in two dimensions
+		// saddles have both ascending and descending separatrices.
+		std::vector<std::pair<size_t, bool>> start;
+		for (size_t c = 0; c < crit.size(); ++c)
+		{
+			unsigned r = msc.cell_rank(crit[c]);
+			if (r == 1) start.emplace_back(c, false);
+			if (r == R - 1) start.emplace_back(c, true);
+		}
+
+		arcs.resize(2 * start.size());
+
+		#pragma omp parallel for schedule(dynamic, 16)
+		for (size_t j = 0; j < start.size(); ++j)
+		{
+			size_t c = start[j].first, s = crit[c];
+			bool up = start[j].second;
+			unsigned k = single_axis(s, not up);
+			size_t u = box.unit_vector(k);
+			size_t f[2] = { box.add(s, u), box.sub(s, u) };
+
+			for (unsigned m = 0; m < 2; ++m)
+			{
+				Arc &a = arcs[2 * j + m];
+				a.saddle = c;
+				a.ascending = up;
+				a.cells = trace(s, f[m], up);
+				a.extremum = a.end = crit_index.at(a.cells.back());
+			}
+		}
+	}
+	// }}}2
+
+	// Complex::pair_extrema {{{2
+	/*
+	 * Minima are paired with saddles taken from low to high, maxima
+	 * with saddles from high to low. Since crit is sorted on value,
+	 * the index in crit gives the age of an extremum.
+	 */
+	template <unsigned R>
+	void Complex<R>::pair_extrema(bool ascending, double threshold)
+	{
+		std::vector<size_t> parent(crit.size());
+		std::iota(parent.begin(), parent.end(), 0);
+
+		auto find = [&parent] (size_t x)
+		{
+			while (parent[x] != x)
+				x = parent[x] = parent[parent[x]];
+			return x;
+		};
+
+		auto older = [ascending] (size_t a, size_t b)
+		{
+			return (ascending ? a > b : a < b);
+		};
+
+		std::vector<size_t> order;
+		for (size_t j = 0; j < arcs.size(); j += 2)
+			if (arcs[j].ascending == ascending)
+				order.push_back(j);
+
+		if (ascending) std::reverse(order.begin(), order.end());
+
+		for (size_t j : order)
+		{
+			size_t s = arcs[j].saddle,
+			       a = find(arcs[j].extremum),
+			       b = find(arcs[j + 1].extremum);
+
+			if (a == b) continue;
+			if (older(a, b)) std::swap(a, b);
+
+			double p = std::abs(double(msc.cell_value(crit[s]))
+				- double(msc.cell_value(crit[a])));
+			pairs.push_back(Pair{a, s, p});
+			parent[a] = b;
+
+			if (p < threshold)
+			{
+				cancelled[a] = cancelled[s] = true;
+				survivor[a] = b;
+			}
+		}
+	}
+	// }}}2
+
+	// Complex::representative {{{2
+	template <unsigned R>
+	size_t Complex<R>::representative(size_t c) const
+	{
+		while (survivor[c] != c)
+			c = survivor[c];
+		return c;
+	}
+	// }}}2
+
+	// Complex::save {{{2
+	/*
+	 * Records: the critical cells, as positions in the double box,
+	 * with their rank and value; the persistence pairs as indices into
+	 * the critical cells; and the separatrices, as pairs of critical
+	 * cells with an offset into the concatenated list of their cells.
+	 * After simplification the cells of a separatrix may end on a
+	 * cancelled extremum in stead of the one it is linked to; that
+	 * cell is given, as an index into the critical cells, by
+	 * "separatrix-end".
+	 */
+	template <unsigned R>
+	template <typename Output>
+	void Complex<R>::save(Output &fo) const
+	{
+		typedef mVector<int, R> iVector;
+		typedef mVector<int, 2> Link;
+
+		Array<iVector> cx(crit.size());
+		Array<unsigned> rank(crit.size());
+		Array<double> value(crit.size());
+		for (size_t c = 0; c < crit.size(); ++c)
+		{
+			cx[c] = iVector(box.dvec(crit[c]));
+			rank[c] = msc.cell_rank(crit[c]);
+			value[c] = msc.cell_value(crit[c]);
+		}
+
+		Array<Link> pl(pairs.size());
+		Array<double> persistence(pairs.size());
+		for (size_t j = 0; j < pairs.size(); ++j)
+		{
+			pl[j] = Link({int(pairs[j].extremum), int(pairs[j].saddle)});
+			persistence[j] = pairs[j].persistence;
+		}
+
+		Array<Link> al(arcs.size());
+		Array<unsigned> offset(arcs.size() + 1), end(arcs.size());
+		offset[0] = 0;
+		for (size_t j = 0; j < arcs.size(); ++j)
+		{
+			al[j] = Link({int(arcs[j].saddle), int(arcs[j].extremum)});
+			end[j] = arcs[j].end;
+			offset[j + 1] = offset[j] + arcs[j].cells.size();
+		}
+
+		Array<iVector> path(offset[arcs.size()]);
+		#pragma omp parallel for
+		for (size_t j = 0; j < arcs.size(); ++j)
+			for (size_t m = 0; m < arcs[j].cells.size(); ++m)
+				path[offset[j] + m] = iVector(box.dvec(arcs[j].cells[m]));
+
+		save_to_file(fo, cx, "critical");
+		save_to_file(fo, rank, "critical-rank");
+		save_to_file(fo, value, "critical-value");
+		save_to_file(fo, pl, "persistence-pairs");
+		save_to_file(fo, persistence, "persistence");
+		save_to_file(fo, al, "separatrices");
+		save_to_file(fo, end, "separatrix-end");
+		save_to_file(fo, offset, "separatrix-offset");
+		save_to_file(fo, path, "separatrix-cells");
+	}
+	// }}}2
+
+	// Complex::write_ply {{{2
+	/*
+	 * Each separatrix becomes a polyline. Cells are unwrapped along
+	 * the path, so that lines crossing the periodic boundary stay in
+	 * one piece; the vertices of different arcs are not shared. Like
+	 * the cells, the lines stop at the end of the arc, which after
+	 * simplification may be a cancelled extremum.
+	 */
+	template <unsigned R>
+	void Complex<R>::write_ply(std::string const &filename, double L) const
+	{
+		double h = L / box.extent();
+		int N = box.extent();
+
+		PLY::PLY ply;
+		ply.comment("Morse-Smale complex, separatrices.");
+
+		ply.add_element("vertex",
+			PLY::property<float>("x"),
+			PLY::property<float>("y"),
+			PLY::property<float>("z"),
+			PLY::property<float>("value"));
+
+		std::vector<std::pair<int, int>> edges;
+		std::vector<float> edge_persistence;
+		int n = 0;
+
+		for (Arc const &a : arcs)
+		{
+			mVector<double, R> x = box.dvec(a.cells[0]);
+			for (size_t m = 0; m < a.cells.size(); ++m)
+			{
+				if (m > 0)
+				{
+					mVector<double, R> d = box.dvec(a.cells[m]) - box.dvec(a.cells[m - 1]);
+					for (unsigned k = 0; k < R; ++k)
+						d[k] -= N * std::round(d[k] / N);
+					x += d;
+					edges.emplace_back(n - 1, n);
+					edge_persistence.push_back(std::abs(
+						double(msc.cell_value(crit[a.saddle]))
+						- double(msc.cell_value(crit[a.extremum]))));
+				}
+
+				ply.put_data(float(x[0] * h), float(x[1] * h),
+					float(R == 3 ? x[2] * h : 0.0),
+					float(msc.cell_value(a.cells[m])));
+				++n;
+			}
+		}
+
+		ply.add_element("edge",
+			PLY::property<int>("vertex1"),
+			PLY::property<int>("vertex2"),
+			PLY::property<float>("persistence"));
+
+		for (size_t j = 0; j < edges.size(); ++j)
+			ply.put_data(edges[j].first, edges[j].second, edge_persistence[j]);
+
+		ply.save(filename);
+	}
+	// }}}2
+	// }}}1
+}
+
+// vim:sw=4:ts=4:fdm=marker
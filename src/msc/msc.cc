@@ -1,12 +1,91 @@
 #include "../base/system.hh"
 #include "../base/format.hh"
 #include "../base/boxconfig.hh"
+#include "../base/hdf5.hh"
 
 #include "../misc/gradient.hh"
 #include "msc.hh"
+#include "complex.hh"
 
 using namespace System;
 
+template <unsigned R, typename Output>
+void write_records(Argv const &args, Header const &H, DMT::Complex<R> const &cx,
+	MappedArray<double> density, Output &fo)
+{
+	cx.save(fo);
+
+	auto box = make_ptr<BoxConfig<R>>(H.get<unsigned>("mbits"), H.get<double>("size"));
+
+	// the Hessian is streamed: at most one pair of components is
+	// held at a time, besides the density.
+	if (args.get<bool>("hessian"))
+		DMT::write_hessian<R>(fo, box, density);
+
+	if (args.get<bool>("eigenvalues"))
+	{
+		auto ev = DMT::hessian_eigenvalues<R>(box, density);
+		for (unsigned k = 0; k < R; ++k)
+			save_to_file(fo, ev[k], Misc::format("hessian-eigenvalue-", k));
+	}
+
+	if (args.get<bool>("roots"))
+	{
+		Misc::GradientField<R> G(box, density);
+		std::vector<size_t> cells = G.root_candidates();
+		save_to_file(fo, G.root_candidate_positions(cells), "root-candidates");
+
+		DMT::HessianStream<R> hessian(box, density);
+		auto roots = G.find_roots(cells, hessian, box->scale2());
+
+		std::vector<mVector<double, R>> x;
+		std::vector<unsigned> index;
+		for (auto const &r : roots)
+		{
+			if (not r.converged) continue;
+			x.push_back(r.x * box->scale());
+			index.push_back(r.index);
+		}
+
+		Array<mVector<double, R>> xa(x.size());
+		Array<unsigned> ia(index.size());
+		std::copy(x.begin(), x.end(), xa.begin());
+		std::copy(index.begin(), index.end(), ia.begin());
+		save_to_file(fo, xa, "roots");
+		save_to_file(fo, ia, "root-index");
+	}
+}
+
+template <unsigned R>
+void write_complex(Argv const &args, Header const &H, History const &I,
+	MappedArray<double> density)
+{
+	DMT::MSC<R> msc(H.get<unsigned>("mbits"), density);
+	msc.generate_gradient();
+
+	DMT::Complex<R> cx(msc, args.get<double>("persistence"));
+	std::cerr << cx.critical().size() << " critical cells, "
+		<< cx.persistence_pairs().size() << " persistence pairs, "
+		<< cx.separatrices().size() << " separatrices.\n";
+
+	if (args.get<bool>("hdf5"))
+	{
+		HDF5File fo(Misc::format(args["id"], ".msc.h5"), HDF5File::WRITE);
+		fo.write_header(H, I);
+		write_records<R>(args, H, cx, density, fo);
+	}
+	else
+	{
+		ConanOutput fo(Misc::format(args["id"], ".msc.conan"));
+		H.to_file(fo); I.to_file(fo);
+		write_records<R>(args, H, cx, density, fo);
+	}
+
+	if (args.get<bool>("ply"))
+		cx.write_ply(Misc::format(args["id"], ".msc.ply",
+			args.get<bool>("compress") ? ".gz" : ""), H.get<double>("size"));
+}
+
 void command_msc(int argc, char **argv)
 {
 	Argv args = read_arguments(argc, argv,
@@ -14,7 +93,39 @@ void command_msc(int argc, char **argv)
 
 		Option(Option::VALUED | Option::CHECK, "i", "id", date_string(), 
 			"Identifier of the run. This tag is prefixed to all input "
-			"and output filenames. By default the current date is used. "));
+			"and output filenames. By default the current date is used. "),
+
+		Option(Option::VALUED | Option::CHECK, "", "persistence", "0",
+			"pairs of critical points with a smaller difference in "
+			"value are cancelled before writing the separatrices."),
+
+		Option(0, "", "ply", "false",
+			"also write the separatrices to <id>.msc.ply."),
+
+		Option(0, "", "compress", "false",
+			"gzip the PLY output, to <id>.msc.ply.gz."),
+
+		Option(0, "", "roots", "false",
+			"also write the cells in which all components of the "
+			"gradient change sign, and the roots of the gradient "
+			"refined within them, with their Morse index."),
+
+		Option(0, "", "hessian", "false",
+			"also write the components of the Hessian of the density, "
+			"as records hessian-ij."),
+
+		Option(0, "", "eigenvalues", "false",
+			"also write the eigenvalues of the Hessian of the density, "
+			"in ascending order and single precision, as records "
+			"hessian-eigenvalue-k."),
+
+		Option(0, "", "hdf5", "false",
+			"read <id>.init.h5 and write <id>.msc.h5 in HDF5 format, "
+			"instead of the .conan files."),
+
+		Option(0, "", "print", "false",
+			"print the critical points and gradient as text, instead "
+			"of writing the complex."));
 		
 	if (args.get<bool>("help"))
 	{
@@ -26,22 +137,43 @@ void command_msc(int argc, char **argv)
 		exit(0);
 	}
 
-	std::ifstream fi(Misc::format(args["id"], ".init.conan"));
-	Header H(fi); History I(fi);
+	Header H; History I;
+	MappedArray<double> density;
+	if (args.get<bool>("hdf5"))
+	{
+		HDF5File fi(Misc::format(args["id"], ".init.h5"));
+		fi.read_header(H, I);
+		density = load_from_file<double>(fi, "density");
+	}
+	else
+	{
+		std::string fn = Misc::format(args["id"], ".init.conan");
+		std::ifstream fi(fn);
+		H.from_file(fi); I.from_file(fi);
+		density = map_from_file<double>(fn, "density");
+	}
+
 	unsigned bits = H.get<unsigned>("mbits");
 	double L = H.get<double>("size");
-	Array<double> density = load_from_file<double>(fi, "density");
+
+	if (not args.get<bool>("print"))
+	{
+		I << args;
+		switch (H.get<unsigned>("dim"))
+		{
+			case 2: write_complex<2>(args, H, I, density); break;
+			case 3: write_complex<3>(args, H, I, density); break;
+		}
+		return;
+	}
 
 	switch (H.get<unsigned>("dim"))
 	{
 		case 2: {
 			auto box = make_ptr<BoxConfig<2>>(bits, L);
-			Misc::Gradient<2> G(box, density);
-			for (size_t i = 0; i < box->size(); ++i)
-			{
-				if (G.root_potentially_within_cell(i))
-					std::cout << box->box().dvec(i) << std::endl;
-			}
+			Misc::GradientField<2> G(box, density);
+			for (size_t i : G.root_candidates())
+				std::cout << box->box().dvec(i) << std::endl;
 
 			std::cout << "\n\n\n";
 			DMT::MSC<2> msc(bits, density);
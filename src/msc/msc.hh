@@ -3,12 +3,13 @@
 #include "../base/mvector.hh"
 #include "../base/mdrange.hh"
 #include "../base/cvector.hh"
+#include "../base/stencil.hh"
+#include "../base/mmap.hh"
 #include "../base/progress.hh"
 
 #include <iostream>
 #include <cstdint>
 #include <vector>
-#include <queue>
 #include <algorithm>
 
 namespace DMT
@@ -19,10 +20,27 @@ namespace DMT
 	using System::mVector;
 
 	// class MSC {{{1
+	/*
+	 * The discrete gradient is built with the lower star method of
+	 * Robins, Wood and Sheppard (2011). The vertices are totally ordered
+	 * by (value, index), and every cell belongs to the lower star of its
+	 * highest vertex. The lower stars are disjoint, so each vertex
+	 * is paired independently, and the vertices are divided over the
+	 * OpenMP threads. The result does not depend on the number of threads.
+	 *
+	 * The lower star reads the values of the 3^R vertices around its
+	 * centre once, from a tile buffer, so the gradient never evaluates
+	 * cell values. Those are only needed for the few cells of the
+	 * complex, and are taken as the maximum over the vertices on demand;
+	 * storing them would cost more than the one byte per cell of the
+	 * gradient itself.
+	 */
 	template <unsigned R>
 	class MSC
 	{
-		struct Cell;
+		enum { n_star = (R == 2 ? 9 : 27), n_vertices = (1 << R) - 1 };
+
+		struct LowerStar;
 
 		cVector<R> 	single_box, double_box;
 					// single_box is the natural geometry of the
@@ -30,29 +48,44 @@ namespace DMT
 					// the resolution to store edges and cells
 					// as well as vertices.
 
-		std::vector<size_t> neighbours;
-					// contains all 27 cells in a little cube
-
 		std::vector<size_t> vertex_star;
-					// contains all 27 cells in a little cube,
+					// contains all 3^R cells in a little cube,
 					// for the double box. centered on a vertex,
 					// this will give the star of the vertex.
+					// Element c has offset (c / 3^k) % 3 - 1
+					// along axis k.
 
-		Array<double>	data;
-					// source data
+		std::vector<size_t> neighbourhood;
+					// the 3^R vertices around a vertex in the
+					// single box, numbered like vertex_star.
 
-		Array<size_t> 	V;
-					// index into box.dx, in [0, 6)
-					// vertices point to one of 6 edges
-					// edges point to one of 4 faces
-					// faces point to one of 2 cells
+		std::vector<std::vector<uint8_t>> star_vertices;
+					// for each cell in the star, its vertices
+					// other than the center, as positions in
+					// the neighbourhood.
+
+		size_t 		pow3[R];
+
+		System::MappedArray<double> data;
+					// source data
 
 		enum cell_tag { UNPAIRED, SOURCE, TARGET, CRITICAL, 
 			MINIMUM, TUNNEL, BRIDGE, MAXIMUM };
 
-		Array<uint8_t> 	tag;
+		enum { TAG_BITS = 3, TAG_MASK = (1 << TAG_BITS) - 1 };
+
+		Array<uint8_t> 	cells;
+					// one byte per cell in the double box; the
+					// low three bits hold the cell_tag, the next
+					// three the direction d of the cell it is
+					// paired with: along axis d / 2, forward if
+					// d is even, backward if odd.
 
-		std::priority_queue<Cell> Q;
+		uint8_t tag(size_t i) const
+		{ return cells[i] & TAG_MASK; }
+
+		size_t neighbour(size_t i, unsigned d) const;
+					// the cell one step in direction d
 
 		uint8_t rank(size_t i) const;
 					// the amount of odd values in the index vector
@@ -63,77 +96,191 @@ namespace DMT
 					// the value is determined by taking the maximum
 					// of the involved vertices.
 
-		uint8_t lower_star(size_t i, std::vector<Cell> &L);
-					
-		void push_minima();
-					// finds the minima in the field and pushes their
-					// cofacets onto the queue
-
-		void push_cofacets(size_t i);
-					// finds the cofacets of a cell, and pushes them
-					// onto the queue, if they are unpaired.
+		bool vertex_less(size_t a, size_t b) const;
+					// total order on the vertices of the single box
 
-		uint8_t unpaired_facets(size_t i);
-		uint8_t unpaired_cofacets(size_t i);
-					// counts the number of unpaired faces to a cell
-					// if it is one, the cell is ready to be paired
-
-		size_t make_pair(size_t i);
-					// make a pair from a cell that has been proven
-					// to have one unpaired face; the function returns
-					// the index of its newly paired counterpart.
+		void process_lower_star(System::Stencil<double, R> const &v);
+					// pairs the cells in the lower star of the
+					// vertex at the centre of the stencil, writing
+					// only to the entries of those cells.
 
 		mVector<int, R> make_vector(size_t i) const;
 
 		System::ptr<Misc::ProgressBar> pb;
 
 		public:
-			MSC(unsigned bits, Array<double> data_);
+			MSC(unsigned bits, System::MappedArray<double> data_);
 			void generate_gradient();
 			void print_critical_points(std::ostream &out) const;
+
+			cVector<R> const &box() const
+			{ return double_box; }
+
+			std::vector<size_t> critical_cells() const;
+					// indices into the double box
+
+			size_t paired_with(size_t i) const
+			{ return (tag(i) == SOURCE or tag(i) == TARGET ?
+				neighbour(i, cells[i] >> TAG_BITS) : i); }
+
+			uint8_t cell_rank(size_t i) const
+			{ return rank(i); }
+
+			double cell_value(size_t i) const
+			{ return value(i); }
 	};
 	// }}}1
 
 	// implementation {{{1
-	// struct MSC::Cell {{{2
+	// struct MSC::LowerStar {{{2
+	// the cells of the star of one vertex, with their state during
+	// the pairing. Cells are sorted by the vertices other than the
+	// center, from high to low, compared lexicographically. The
+	// values of the surrounding vertices are read once, so that the
+	// comparisons do not go back to the data array.
 	template <unsigned R>
-	struct MSC<R>::Cell
+	struct MSC<R>::LowerStar
 	{
-		size_t 		i;
-		double		value;
-		uint8_t		rank;
+		enum state { OUTSIDE, FREE, PAIRED, CRITICAL };
+
+		MSC const	&msc;
+		uint8_t		st[n_star];
+		uint8_t		n_key[n_star];
+		uint8_t		key[n_star][n_vertices];
+		double		nb_value[n_star];
+		size_t		nb_index[n_star];
+
+		LowerStar(MSC const &msc_):
+			msc(msc_) {}
+
+		// the order of vertex_less, on neighbourhood positions
+		bool vertex_less(unsigned a, unsigned b) const
+		{
+			return nb_value[a] < nb_value[b] or
+				(nb_value[a] == nb_value[b] and nb_index[a] < nb_index[b]);
+		}
+
+		bool less(unsigned a, unsigned b) const
+		{
+			for (unsigned j = 0; j < n_key[a] and j < n_key[b]; ++j)
+			{
+				if (key[a][j] == key[b][j]) continue;
+				return vertex_less(key[a][j], key[b][j]);
+			}
+
+			return n_key[a] < n_key[b];
+		}
+
+		unsigned digit(unsigned c, unsigned k) const
+		{
+			return (c / msc.pow3[k]) % 3;
+		}
+
+		// facets in the star have one odd axis made even,
+		// i.e. the offset along that axis set to zero.
+		unsigned free_facets(unsigned c, unsigned *f = nullptr) const
+		{
+			unsigned n = 0;
+			for (unsigned k = 0; k < R; ++k)
+			{
+				unsigned d = digit(c, k);
+				if (d == 1) continue;
+
+				unsigned e = (d == 0 ? c + msc.pow3[k] : c - msc.pow3[k]);
+				if (st[e] == FREE)
+				{
+					++n;
+					if (f) *f = e;
+				}
+			}
+			return n;
+		}
 
-		Cell(size_t i_, double value_, uint8_t rank_):
-			i(i_), value(value_), rank(rank_) {}
+		template <typename Fn>
+		void for_each_cofacet(unsigned c, Fn fn) const
+		{
+			for (unsigned k = 0; k < R; ++k)
+			{
+				if (digit(c, k) != 1) continue;
+				if (st[c - msc.pow3[k]] != OUTSIDE) fn(c - msc.pow3[k]);
+				if (st[c + msc.pow3[k]] != OUTSIDE) fn(c + msc.pow3[k]);
+			}
+		}
 
-		// operator<, the priority_queue gives priority to
-		// high values, we need to prioritize low values.
-		// so I consistently use operator>
-		bool operator<(Cell const &o) const
+		// removes and returns the lowest free cell in the list,
+		// or n_star if there is none.
+		unsigned pop(std::vector<unsigned> &q) const
 		{
-			if (value == o.value) 
-				return rank < o.rank;
+			unsigned best = n_star;
+			size_t at = 0;
+			for (size_t j = 0; j < q.size(); ++j)
+			{
+				if (st[q[j]] != FREE) continue;
+				if (best == n_star or less(q[j], best))
+				{
+					best = q[j];
+					at = j;
+				}
+			}
+
+			if (best != n_star)
+				q.erase(q.begin() + at);
+			else
+				q.clear();
 
-			return (value > o.value);
+			return best;
 		}
 	};
 	// }}}2
 
 	// constructor {{{2
 	template <unsigned R>
-	MSC<R>::MSC(unsigned bits, Array<double> data_):
+	MSC<R>::MSC(unsigned bits, System::MappedArray<double> data_):
 		single_box(bits), double_box(bits+1),
-		data(data_), V(double_box.size()), tag(double_box.size())
+		data(data_), cells(double_box.size())
 	{
-		// generate the 27-neighbourhood
-		mVector<int, R> unit(1);
-		for (mVector<int, R> const &dx : MdRange<R>(mVector<int, R>(3)))
+		for (unsigned k = 0; k < R; ++k)
+			pow3[k] = (k == 0 ? 1 : pow3[k-1] * 3);
+
+		// generate the star of a vertex; negative offsets are taken
+		// per axis with sub, a plain subtraction would borrow from
+		// the neighbouring axis.
+		for (unsigned c = 0; c < n_star; ++c)
 		{
-			neighbours.push_back(single_box.loc(dx) - single_box.loc(unit));
-			vertex_star.push_back(double_box.loc(dx) - double_box.loc(unit));
+			size_t up = 0, down = 0, sup = 0, sdown = 0;
+			std::vector<unsigned> axes;
+
+			for (unsigned k = 0; k < R; ++k)
+			{
+				unsigned d = (c / pow3[k]) % 3;
+				if (d == 2) up |= double_box.unit_vector(k);
+				if (d == 0) down |= double_box.unit_vector(k);
+				if (d == 2) sup |= single_box.unit_vector(k);
+				if (d == 0) sdown |= single_box.unit_vector(k);
+				if (d != 1) axes.push_back(k);
+			}
+
+			vertex_star.push_back(double_box.sub(up, down));
+			neighbourhood.push_back(single_box.sub(sup, sdown));
+
+			// the vertices of cell c keep the digits of c on a
+			// subset of its even axes, and the center elsewhere.
+			std::vector<uint8_t> w;
+			for (unsigned m = 1; m < (1U << axes.size()); ++m)
+			{
+				unsigned v = n_star / 2;
+				for (unsigned j = 0; j < axes.size(); ++j)
+				{
+					if (not ((m >> j) & 1)) continue;
+					unsigned k = axes[j];
+					v = v - pow3[k] + ((c / pow3[k]) % 3) * pow3[k];
+				}
+				w.push_back(v);
+			}
+			star_vertices.push_back(w);
 		}
 
-		std::fill(tag.begin(), tag.end(), UNPAIRED);
+		std::fill(cells.begin(), cells.end(), UNPAIRED);
 	}
 	// }}}2
 
@@ -160,177 +307,140 @@ namespace DMT
 	}
 	// }}}2
 
-	// MSC::lower_star {{{2
+	// MSC::neighbour {{{2
 	template <unsigned R>
-	uint8_t MSC<R>::lower_star(size_t i, std::vector<Cell> &result)
+	inline size_t MSC<R>::neighbour(size_t i, unsigned d) const
 	{
-		uint8_t count = 0;
-		double alpha = value(i);
-
-		for (size_t n : vertex_star)
-		{
-			size_t x = double_box.add(i, n);
-			double y = value(x);
-			uint8_t r = rank(x);
-
-			if (y <= alpha)
-			{
-				result.push_back(Cell(x, y, r));
-				++count;
-			}
-		}
-
-		return count;
+		size_t u = double_box.unit_vector(d / 2);
+		return (d % 2 == 0 ? double_box.add(i, u) : double_box.sub(i, u));
 	}
 	// }}}2
 
-	// MSC::push_cofacets {{{2
+	// MSC::vertex_less {{{2
 	template <unsigned R>
-	void MSC<R>::push_cofacets(size_t i)
+	inline bool MSC<R>::vertex_less(size_t a, size_t b) const
 	{
-		size_t j;
-		for (unsigned k = 0; k < R; ++k)
-		{
-			// cofacets are the cells of dimension d+1
-			// that border the ones of dimension d;
-			// we are looking for the +/- 1 odd extensions
-			// of even numbered indices in the double grid
-			if (not (double_box.i(i, k) & 1U))
-			{
-				j = double_box.add(i, double_box.dx_i[k]);
-				if (tag[j] == UNPAIRED)
-					Q.push(Cell(j, value(j), rank(j)));
-
-				j = double_box.sub(i, double_box.dx_i[k]);
-				if (tag[j] == UNPAIRED)
-					Q.push(Cell(j, value(j), rank(j)));
-			}
-		}
+		return data[a] < data[b] or (data[a] == data[b] and a < b);
 	}
 	// }}}2
 
-	// MSC::push_minima {{{2
+	// MSC::process_lower_star {{{2
 	template <unsigned R>
-	void MSC<R>::push_minima()
+	void MSC<R>::process_lower_star(System::Stencil<double, R> const &v)
 	{
-		for (size_t i = 0; i < single_box.size(); ++i)
+		typedef LowerStar L;
+		L star(*this);
+
+		unsigned centre = n_star / 2;
+		size_t s = v.index(), i = single_box.double_grid(s);
+
+		for (unsigned c = 0; c < n_star; ++c)
 		{
-			double v = data[i];
-			size_t x = i;
+			std::ptrdiff_t o = 0;
+			for (unsigned k = 0; k < R; ++k)
+				o += (int((c / pow3[k]) % 3) - 1) * v.stride(k);
 
-			for (size_t dx : neighbours)
-			{
-				size_t p = single_box.add(i, dx);
-				if (data[p] < v)
-				{
-					x = p;
-					break;
-				}
-			}
+			star.nb_index[c] = single_box.add(s, neighbourhood[c]);
+			star.nb_value[c] = v[o];
+		}
+
+		for (unsigned c = 0; c < n_star; ++c)
+		{
+			star.st[c] = L::FREE;
+			star.n_key[c] = star_vertices[c].size();
 
-			if (x == i)
+			for (unsigned j = 0; j < star.n_key[c]; ++j)
 			{
-				// std::cerr << single_box.c2m(i) << ": minimal\n";
-				x = single_box.double_grid(i);
-				tag[x] = CRITICAL;
-				if (pb) pb->tic();
-				push_cofacets(x);
+				unsigned w = star_vertices[c][j];
+				if (not star.vertex_less(w, centre))
+					star.st[c] = L::OUTSIDE;
+				star.key[c][j] = w;
 			}
+
+			std::sort(star.key[c], star.key[c] + star.n_key[c],
+				[&star] (unsigned a, unsigned b) { return star.vertex_less(b, a); });
 		}
-	}
-	// }}}2
 
-	// MSC::unpaired_faces {{{2
-	template <unsigned R>
-	uint8_t MSC<R>::unpaired_facets(size_t i)
-	{
-		uint8_t n = 0;
-		for (unsigned k = 0; k < R; ++k)
+		auto cell = [&] (unsigned c) { return double_box.add(i, vertex_star[c]); };
+
+		// a and b differ along one axis k; the direction from a
+		// to b is 2k if b lies forward of a, 2k + 1 otherwise.
+		auto pair = [&] (unsigned a, unsigned b)
 		{
-			if (double_box.i(i, k) & 1U)
-			{
-				if (tag[double_box.add(i, double_box.dx_i[k])] == UNPAIRED)
-					++n;
+			unsigned k = 0;
+			while (star.digit(a, k) == star.digit(b, k)) ++k;
+			uint8_t d = 2 * k + (star.digit(b, k) < star.digit(a, k));
 
-				if (tag[double_box.sub(i, double_box.dx_i[k])] == UNPAIRED)
-					++n;
-			}
-		}
-		return n;
-	}
-	// }}}2
+			cells[cell(a)] = SOURCE | (d << TAG_BITS);
+			cells[cell(b)] = TARGET | ((d ^ 1) << TAG_BITS);
+			star.st[a] = star.st[b] = L::PAIRED;
+		};
 
-	// MSC::unpaired_cofacet {{{2
-	template <unsigned R>
-	uint8_t MSC<R>::unpaired_cofacets(size_t i)
-	{
-		uint8_t n = 0;
-		for (unsigned k = 0; k < R; ++k)
+		auto critical = [&] (unsigned c)
 		{
-			if (not (double_box.i(i, k) & 1U))
-			{
-				if (tag[double_box.add(i, double_box.dx_i[k])] == UNPAIRED)
-					++n;
+			cells[cell(c)] = CRITICAL;
+			star.st[c] = L::CRITICAL;
+		};
+
+		// the steepest edge; edges are the cells with one vertex
+		// besides the center.
+		std::vector<unsigned> zero, one;
+		unsigned delta = n_star;
+		for (unsigned c = 0; c < n_star; ++c)
+		{
+			if (star.st[c] != L::FREE or star.n_key[c] != 1)
+				continue;
 
-				if (tag[double_box.sub(i, double_box.dx_i[k])] == UNPAIRED)
-					++n;
-			}
+			if (delta == n_star or star.less(c, delta))
+				delta = c;
 		}
-		return n;
-	}
-	// }}}2
 
-	// MSC::make_pair {{{2
-	// d-cell i is being paired with its single remaining
-	// unpaired coface.
-	template <unsigned R>
-	size_t MSC<R>::make_pair(size_t i)
-	{
-		size_t j = 0, q = 0;
+		if (delta == n_star)
+		{
+			critical(centre);
+			return;
+		}
 
-		bool paired = false;
-		for (unsigned k = 0; k < R; ++k)
+		pair(centre, delta);
+
+		for (unsigned c = 0; c < n_star; ++c)
+			if (star.st[c] == L::FREE and star.n_key[c] == 1)
+				zero.push_back(c);
+
+		auto push_ready = [&] (unsigned c)
 		{
-			if (double_box.i(i, k) & 1U)
+			star.for_each_cofacet(c, [&] (unsigned b)
 			{
-				j = double_box.add(i, double_box.dx_i[k]);
-				if (tag[j] == UNPAIRED) 
-				{
-					if (paired)
-					{
-						std::cerr << "trying to pair, but multiple faces are still unpaired\n";
-						throw "error!";
-					}
-					paired = true;
-					q = j;
-				}
+				if (star.st[b] == L::FREE and star.free_facets(b) == 1)
+					one.push_back(b);
+			});
+		};
+
+		push_ready(delta);
 
-				j = double_box.sub(i, double_box.dx_i[k]);
-				if (tag[j] == UNPAIRED) 
+		while (true)
+		{
+			unsigned a;
+			while ((a = star.pop(one)) != n_star)
+			{
+				unsigned f = 0;
+				if (star.free_facets(a, &f) == 0)
 				{
-					if (paired)
-					{
-						std::cerr << "trying to pair, but multiple faces are still unpaired\n";
-						throw "error!";
-					}
-					paired = true;
-					q = j;
+					zero.push_back(a);
+					continue;
 				}
-			}
-		}
 
-		if (not paired)
-		{
-			std::cerr << "trying to pair, but no faces are unpaired\n";
-			throw "error!";
-		}
+				pair(f, a);
+				push_ready(a);
+				push_ready(f);
+			}
 
-		V[q] = i;
-		V[i] = q;
-		tag[i] = TARGET; tag[q] = SOURCE;
-		if (pb) { pb->tic(); pb->tic(); }
+			unsigned g = star.pop(zero);
+			if (g == n_star) break;
 
-		return q;
+			critical(g);
+			push_ready(g);
+		}
 	}
 	// }}}2
 	
@@ -338,37 +448,17 @@ namespace DMT
 	template <unsigned R>
 	void MSC<R>::generate_gradient()
 	{
-		pb.reset(new Misc::ProgressBar(double_box.size(), "finding critical points"));
+		size_t M = single_box.size();
+		pb.reset(new Misc::ProgressBar(M, "finding critical points"));
 
-		push_minima();
-		size_t cnt = 0;
-		while (not Q.empty())
+		System::Tiling<R> tile(single_box, 1);
+		System::for_each_stencil(tile, data, [this] (System::Stencil<double, R> const &v)
 		{
-			Cell c = Q.top(); Q.pop();
-			if (tag[c.i] != UNPAIRED)
-				continue;
+			process_lower_star(v);
+			if (v.index() % 4096 == 0) pb->tic(4096);
+		});
 
-			//std::cout << double_box.c2m(c.i) << " " << cnt++ << " " << c.value << std::endl;
-
-			uint8_t z = unpaired_facets(c.i);
-			if (z == 1)
-			{
-				size_t j = make_pair(c.i);
-				//std::cout << double_box.c2m(j) << " " << cnt++ << " " << value(j) << std::endl;
-				push_cofacets(c.i);
-				push_cofacets(j);
-			}
-			
-			if (z == 0)
-			{
-				push_cofacets(c.i);
-				tag[c.i] = CRITICAL;
-				if (pb) pb->tic();
-			}
-		}
-
-		if (pb) pb->finish();
-		//std::cout << "\n\n";
+		pb->finish();
 	}
 	// }}}2
 
@@ -376,7 +466,7 @@ namespace DMT
 	template <unsigned R>
 	mVector<int, R> MSC<R>::make_vector(size_t i) const
 	{
-		auto v = double_box.dvec(double_box.sub(V[i], i));
+		auto v = double_box.dvec(double_box.sub(paired_with(i), i));
 		int N = double_box.extent();
 		for (unsigned k = 0; k < R; ++k)
 			if (v[k] > N/2)
@@ -384,6 +474,16 @@ namespace DMT
 		return v;
 	}
 
+	template <unsigned R>
+	std::vector<size_t> MSC<R>::critical_cells() const
+	{
+		std::vector<size_t> result;
+		for (size_t x = 0; x < double_box.size(); ++x)
+			if (tag(x) == CRITICAL)
+				result.push_back(x);
+		return result;
+	}
+
 	template <unsigned R>
 	void MSC<R>::print_critical_points(std::ostream &out) const
 	{
@@ -397,7 +497,7 @@ namespace DMT
 
 		for (size_t x = 0; x < double_box.size(); ++x)
 		{
-			if ((tag[x] == SOURCE) and (V[x] <= double_box.size()))
+			if (tag(x) == SOURCE)
 				out << double_box.c2m(x) << " " << make_vector(x) << "\n";
 		}
 
@@ -406,7 +506,7 @@ namespace DMT
 
 		for (size_t x = 0; x < double_box.size(); ++x)
 		{
-			if (tag[x] == CRITICAL)
+			if (tag(x) == CRITICAL)
 				out << double_box.dvec(x) << " " << int(rank(x)) << std::endl;
 		}
 	}
@@ -0,0 +1,204 @@
+#ifdef UNITTEST
+#include "../base/unittest.hh"
+#include "../base/system.hh"
+#include "msc.hh"
+#include "complex.hh"
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace System;
+
+template <unsigned R>
+std::vector<size_t> count_critical(DMT::MSC<R> const &msc, unsigned bits)
+{
+	std::vector<size_t> n(R + 1, 0);
+	cVector<R> double_box(bits + 1);
+
+	for (size_t x = 0; x < double_box.size(); ++x)
+	{
+		size_t y = msc.paired_with(x);
+		if (y == x)
+		{
+			++n[msc.cell_rank(x)];
+			continue;
+		}
+
+		if (msc.paired_with(y) != x)
+			throw "gradient pairs are not symmetric.";
+
+		if (abs(int(msc.cell_rank(x)) - int(msc.cell_rank(y))) != 1)
+			throw "gradient pairs cells that are not facets of each other.";
+	}
+
+	return n;
+}
+
+Test::Unit MSC_gradient_test("0031 - discrete gradient",
+	"A sum of cosines on the torus has one minimum, one maximum and "
+	"R choose k saddles of index k; the discrete gradient should find "
+	"exactly these, and the result should not depend on the number "
+	"of threads. Cell values should be the maximum over the "
+	"vertices of each cell.",
+	[] ()
+{
+	unsigned bits = 4, N = 1 << bits;
+	cVector<3> box(bits);
+	Array<double> f(box.size());
+
+	for (size_t i = 0; i < box.size(); ++i)
+	{
+		mVector<double, 3> x = box.dvec(i);
+		f[i] = cos(2 * M_PI * (x[0] + 0.3) / N)
+		     + 0.9 * cos(2 * M_PI * (x[1] + 0.1) / N)
+		     + 0.8 * cos(2 * M_PI * (x[2] + 0.2) / N);
+	}
+
+	DMT::MSC<3> msc(bits, f);
+	msc.generate_gradient();
+	auto n = count_critical<3>(msc, bits);
+
+	std::cerr << "critical cells: " << n[0] << " " << n[1] << " "
+		<< n[2] << " " << n[3] << std::endl;
+
+	if (n != std::vector<size_t>({1, 3, 3, 1}))
+		throw "wrong number of critical cells.";
+
+	// random data: the Euler characteristic of the torus is zero.
+	Array<double> g(box.size());
+	generate(g, Gaussian_white_noise(5));
+
+	DMT::MSC<3> a(bits, g);
+	a.generate_gradient();
+	auto m = count_critical<3>(a, bits);
+
+	if (int(m[0]) - int(m[1]) + int(m[2]) - int(m[3]) != 0)
+		throw "critical cells do not add up to the Euler characteristic.";
+
+	// cell values are the maximum over the vertices.
+	cVector<3> double_box(bits + 1);
+	for (size_t x = 0; x < double_box.size(); ++x)
+	{
+		double v = g[double_box.half_grid(x)];
+		for (size_t dx : double_box.sq_i)
+			v = std::max(v, g[double_box.add_half(x, dx)]);
+
+		if (a.cell_value(x) != v)
+			throw "cell value is not the maximum over the vertices.";
+	}
+
+#ifdef _OPENMP
+	int threads = omp_get_max_threads();
+	omp_set_num_threads(1);
+	DMT::MSC<3> b(bits, g);
+	b.generate_gradient();
+	omp_set_num_threads(threads);
+
+	for (size_t x = 0; x < double_box.size(); ++x)
+		if (a.paired_with(x) != b.paired_with(x))
+			throw "gradient depends on the number of threads.";
+#endif
+
+	return true;
+});
+
+template <unsigned R>
+void check_complex(Array<double> f, unsigned bits)
+{
+	DMT::MSC<R> msc(bits, f);
+	msc.generate_gradient();
+	auto n = count_critical<R>(msc, bits);
+
+	DMT::Complex<R> full(msc);
+	cVector<R> double_box(bits + 1);
+
+	for (auto const &a : full.separatrices())
+	{
+		if (a.cells.front() != full.critical()[a.saddle] or
+		    a.cells.back() != full.critical()[a.extremum] or a.end != a.extremum)
+			throw "separatrix does not connect its critical cells.";
+
+		unsigned r = (a.ascending ? R : 0);
+		if (msc.cell_rank(a.cells.back()) != r)
+			throw "separatrix does not end on an extremum.";
+
+		for (size_t m = 1; m < a.cells.size(); ++m)
+		{
+			int d = int(msc.cell_rank(a.cells[m])) - int(msc.cell_rank(a.cells[m - 1]));
+			size_t x = a.cells[m], y = a.cells[m - 1];
+			bool step = false;
+			for (unsigned k = 0; k < R; ++k)
+				step |= (double_box.add(y, double_box.unit_vector(k)) == x
+				      or double_box.sub(y, double_box.unit_vector(k)) == x);
+
+			if (abs(d) != 1 or not step)
+				throw "separatrix is not a path of facets.";
+		}
+	}
+
+	// on the torus, all but one minimum and one maximum are paired.
+	if (full.persistence_pairs().size() != n[0] - 1 + n[R] - 1)
+		throw "wrong number of persistence pairs.";
+
+	// with an infinite threshold all these pairs are cancelled, and
+	// the remaining arcs end on the global extrema.
+	DMT::Complex<R> simple(msc, HUGE_VAL);
+	size_t lo = 0, hi = simple.critical().size() - 1;
+	for (auto const &a : simple.separatrices())
+	{
+		if (simple.is_cancelled(a.saddle))
+			throw "separatrix of a cancelled saddle was kept.";
+		if (a.extremum != (a.ascending ? hi : lo))
+			throw "simplified separatrix does not end on a global extremum.";
+		if (a.cells.back() != simple.critical()[a.end] or
+		    simple.representative(a.end) != a.extremum)
+			throw "simplified separatrix does not keep its original end.";
+	}
+
+	std::cerr << R << "D: " << full.separatrices().size() << " separatrices, "
+		<< full.persistence_pairs().size() << " pairs, "
+		<< simple.separatrices().size() << " separatrices after simplification."
+		<< std::endl;
+}
+
+Test::Unit MSC_complex_test("0032 - Morse-Smale complex",
+	"Separatrices should be V-paths of facets that run from the saddles "
+	"to the extrema. All minima and maxima but the global ones should "
+	"be in a persistence pair, and after cancelling all pairs the "
+	"remaining separatrices should end on the global extrema.",
+	[] ()
+{
+	unsigned bits = 4, N = 1 << bits;
+	cVector<3> box(bits);
+	Array<double> f(box.size());
+
+	for (size_t i = 0; i < box.size(); ++i)
+	{
+		mVector<double, 3> x = box.dvec(i);
+		f[i] = cos(2 * M_PI * (x[0] + 0.3) / N)
+		     + 0.9 * cos(2 * M_PI * (x[1] + 0.1) / N)
+		     + 0.8 * cos(2 * M_PI * (x[2] + 0.2) / N);
+	}
+
+	DMT::MSC<3> msc(bits, f);
+	msc.generate_gradient();
+	DMT::Complex<3> cx(msc);
+
+	if (cx.separatrices().size() != 12 or cx.persistence_pairs().size() != 0)
+		throw "cosine field should have twelve separatrices and no pairs.";
+
+	Array<double> g(box.size());
+	generate(g, Gaussian_white_noise(7));
+	check_complex<3>(g, bits);
+
+	cVector<2> box2(6);
+	Array<double> h(box2.size());
+	generate(h, Gaussian_white_noise(8));
+	check_complex<2>(h, 6);
+
+	return true;
+});
+
+#endif
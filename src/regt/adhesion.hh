@@ -89,6 +89,11 @@ class Adhesion_base<2>
 			return n->vertex(i)->point();
 		}
 
+		size_t number_of_nodes() const
+		{
+			return rt->number_of_faces();
+		}
+
 		void for_each_node(std::function<void (Node)> f)
 		{
 			for (auto i  = rt->finite_faces_begin();
@@ -158,6 +163,11 @@ class Adhesion_base<3>
 			return rt->point(n, i);
 		}
 
+		size_t number_of_nodes() const
+		{
+			return rt->number_of_finite_cells();
+		}
+
 		void for_each_node(std::function<void (Node)> f)
 		{
 			for (auto i  = rt->finite_cells_begin();
@@ -206,17 +216,21 @@ class Adhesion: public Adhesion_base<R_>
 		}
 
 		void from_potential_with_glass(Array<dVector<R>> glass,
-			Array<double> phi, double t)
+			Array<double> phi, double t, bool spline = false)
 		{
-			Misc::Interpol::Linear<Array<double>,R> pot(box, phi);
-
-			auto point_set = System::map(glass,
-				[&] (System::mVector<double,R> const &x) -> Weighted_point
+			Array<double> w = (spline ?
+				Misc::Interpol::Spline<Array<double>,R>(box, phi)
+					.sample(glass, box->scale()) :
+				Misc::Interpol::Linear<Array<double>,R>(box, phi)
+					.sample(glass, box->scale()));
+
+			auto point_set = System::map(System::Range<size_t>(glass.size()),
+				[&] (size_t i) -> Weighted_point
 			{
 				Point Q = Base::make_Point(
-					[&] (unsigned k) -> double { return x[k]; });
+					[&] (unsigned k) -> double { return glass[i][k]; });
 
-				return Weighted_point(Q, pot(x / box->scale()) * 2 * t);
+				return Weighted_point(Q, w[i] * 2 * t);
 			});
 
 			insert(point_set.begin(), point_set.end());
@@ -44,6 +44,9 @@ ptr<Adhesion<R>> make_adhesion2(Header const &H, Array<double> phi)
 
 	if (H.get<bool>("glass"))
 	{
+		if (H["interpolation"] != "linear" and H["interpolation"] != "spline")
+			throw "unknown interpolation, choose linear or spline.";
+
 		std::string fn_glass = timed_filename(H["id"], "glass", -1);
 		std::cerr << "reading glass ... " << fn_glass << "\n";
 		std::ifstream fi(fn_glass);
@@ -52,7 +55,8 @@ ptr<Adhesion<R>> make_adhesion2(Header const &H, Array<double> phi)
 
 		Array<mVector<double,R>> glass(fi);
 		std::cerr << "creating triangulation ... ";
-		adh->from_potential_with_glass(glass, phi, t);
+		adh->from_potential_with_glass(glass, phi, t,
+			H["interpolation"] == "spline");
 		std::cerr << "[done]\n";
 		return adh;
 	}
@@ -113,6 +117,10 @@ void cmd_regt2(int argc, char **argv)
 			"use a glass file in stead of a regular grid pattern. "
 			"The file should be called <id>.glass.init.conan."}),
 
+		Option({Option::VALUED | Option::CHECK, "", "interpolation", "linear",
+			"interpolation used to sample the potential at glass "
+			"particle positions, either 'linear' or 'spline' (tricubic)."}),
+
 		Option({0, "p", "persistence", "false",
 			"write the result in the form of persistence data, readable "
 			"by the [phat] package."}),
@@ -123,6 +131,13 @@ void cmd_regt2(int argc, char **argv)
 		Option({0, "ply", "ply", "false",
 			"write data to PLY, only for 3D."}),
 
+		Option({0, "", "compress", "false",
+			"gzip the PLY output."}),
+
+		Option({0, "", "hdf5", "false",
+			"save nodes to HDF5; with --ply, walls and filaments are "
+			"written to <id>.web.<time>.h5 instead of PLY."}),
+
 		Option({Option::VALUED | Option::CHECK, "", "minli-wall", "0",
 			"minimal Lagrangian interval to store, a higher value "
 			"reduces size of files written. Number is length."}),
@@ -1,5 +1,6 @@
 #pragma once
 #include "adhesion.hh"
+#include "../base/hdf5.hh"
 
 namespace Conan
 {
@@ -85,19 +86,28 @@ namespace Conan
 				std::ostringstream ss;
 				ss << std::setfill('0') << std::setw(5) << static_cast<int>(round(t * 10000));
 
-				std::string fn_walls = Misc::format(H["new-id"], ".walls.", ss.str(), ".ply"),
-					    fn_filam = Misc::format(H["new-id"], ".filam.", ss.str(), ".ply");
+				std::string gz = (H.get<bool>("compress") ? ".gz" : ""),
+					    fn_walls = Misc::format(H["new-id"], ".walls.", ss.str(), ".ply", gz),
+					    fn_filam = Misc::format(H["new-id"], ".filam.", ss.str(), ".ply", gz);
 
-				write_filam_to_ply(fn_filam, H.get<double>("minli-fila"));
-				write_walls_to_ply(fn_walls, H.get<double>("minli-wall"));
+				if (H.get<bool>("hdf5"))
+					write_web_to_hdf5(H, Misc::format(H["new-id"], ".web.", ss.str(), ".h5"));
+				else
+				{
+					write_filam_to_ply(fn_filam, H.get<double>("minli-fila"));
+					write_walls_to_ply(fn_walls, H.get<double>("minli-wall"));
+				}
 
 				Base::save_all(H);
 			}
 
-			void write_filam_to_ply(std::string const &filename, double minli) const
+			typedef std::vector<std::pair<Array<unsigned>,double>> Components;
+
+			// the filaments, as pairs of vertices in cell_dual with
+			// the squared area of the facet.
+			Components filaments(VoronoiMap<Base> &cell_dual, double minli) const
 			{
-				VoronoiMap<Base> cell_dual(box, rt);
-				std::vector<std::pair<Array<unsigned>,double>> W;
+				Components W;
 
 				std::for_each(
 					rt->finite_facets_begin(),
@@ -119,6 +129,14 @@ namespace Conan
 					W.push_back(std::pair<Array<unsigned>,double>(P, l));
 				});
 
+				return W;
+			}
+
+			void write_filam_to_ply(std::string const &filename, double minli) const
+			{
+				VoronoiMap<Base> cell_dual(box, rt);
+				Components W = filaments(cell_dual, minli);
+
 				PLY::PLY ply;
 				ply.comment("Adhesion model, filament component.");
 
@@ -139,10 +157,11 @@ namespace Conan
 				ply.save(filename);
 			}
 
-			void write_walls_to_ply(std::string const &filename, double minli) const
+			// the walls, as polygons of vertices in cell_dual with the
+			// squared length of the edge.
+			Components walls(VoronoiMap<Base> &cell_dual, double minli) const
 			{
-				VoronoiMap<Base> cell_dual(box, rt);
-				std::vector<std::pair<Array<unsigned>,double>> W;
+				Components W;
 
 				std::for_each(
 					rt->finite_edges_begin(),
@@ -165,6 +184,14 @@ namespace Conan
 					W.push_back(std::pair<Array<unsigned>,double>(P, l));
 				});
 
+				return W;
+			}
+
+			void write_walls_to_ply(std::string const &filename, double minli) const
+			{
+				VoronoiMap<Base> cell_dual(box, rt);
+				Components W = walls(cell_dual, minli);
+
 				PLY::PLY ply;
 				ply.comment("Adhesion model, wall component.");
 
@@ -184,6 +211,69 @@ namespace Conan
 
 				ply.save(filename);
 			}
+
+			/*!
+			 * Writes the filaments and walls to one HDF5 file, each
+			 * in its own group with the vertices and density. The
+			 * filaments are stored as pairs of vertex indices, the
+			 * walls as a list of vertex indices, where the polygon j
+			 * runs from offset[j] to offset[j+1].
+			 */
+			void write_web_to_hdf5(Header const &H, std::string const &filename) const
+			{
+				typedef System::mVector<float, 3> fVector;
+				typedef System::mVector<int, 2> Link;
+
+				System::HDF5File fo(filename, System::HDF5File::WRITE);
+				History I; I.update("<adhesion code>");
+				fo.write_header(H, I);
+
+				auto save_vertices = [&fo] (VoronoiMap<Base> const &cell_dual,
+					std::string const &name)
+				{
+					Array<fVector> x(0);
+					for (Point const &v : cell_dual.vertices())
+						x->push_back(fVector({float(v[0]), float(v[1]), float(v[2])}));
+					save_to_file(fo, x, name);
+				};
+
+				{
+					VoronoiMap<Base> cell_dual(box, rt);
+					Components W = filaments(cell_dual, H.get<double>("minli-fila"));
+
+					Array<Link> edges(0);
+					Array<float> density(0);
+					for (auto f : W)
+					{
+						edges->push_back(Link({int((*f.first)[0]), int((*f.first)[1])}));
+						density->push_back(f.second);
+					}
+
+					save_vertices(cell_dual, "filaments/vertices");
+					save_to_file(fo, edges, "filaments/edges");
+					save_to_file(fo, density, "filaments/density");
+				}
+
+				{
+					VoronoiMap<Base> cell_dual(box, rt);
+					Components W = walls(cell_dual, H.get<double>("minli-wall"));
+
+					Array<unsigned> offset(1, 0), index(0);
+					Array<float> density(0);
+					for (auto f : W)
+					{
+						if (f.first.size() <= 2) continue;
+						for (unsigned v : f.first) index->push_back(v);
+						offset->push_back(index.size());
+						density->push_back(f.second);
+					}
+
+					save_vertices(cell_dual, "walls/vertices");
+					save_to_file(fo, offset, "walls/offset");
+					save_to_file(fo, index, "walls/index");
+					save_to_file(fo, density, "walls/density");
+				}
+			}
 	};
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "adhesion.hh"
+#include "../base/hdf5.hh"
 
 namespace Conan
 {
@@ -162,18 +163,42 @@ namespace Conan
 				});
 			}
 
+			// nodes are written as they are computed, and never held
+			// in memory all at once; their number is known in advance.
 			void save_nodes_binary(std::ostream &fo, double t)
 			{
-				Array<VelocityInfo<R>> data;
+				System::BlockWriter<VelocityInfo<R>> data(fo, "nodes",
+					Base::number_of_nodes());
 				Base::for_each_node([&] (Node i)
 				{
-					data->push_back({
+					data.push_back({
 						Base::Point2dVector(rt->dual(i)),
 						velocity(i, t),
 						Base::measure(i), Base::face_cnt(i)});
 				});
 
-				save_to_file(fo, data, "nodes");
+				data.close();
+			}
+
+			// the fields of VelocityInfo as separate datasets in the
+			// group nodes, so that they can be read one at a time.
+			void save_nodes_hdf5(System::HDF5File &fo, double t)
+			{
+				Array<dVector<R>> x(0), v(0);
+				Array<double> mass(0);
+				Array<int> type(0);
+				Base::for_each_node([&] (Node i)
+				{
+					x->push_back(Base::Point2dVector(rt->dual(i)));
+					v->push_back(velocity(i, t));
+					mass->push_back(Base::measure(i));
+					type->push_back(Base::face_cnt(i));
+				});
+
+				save_to_file(fo, x, "nodes/pos");
+				save_to_file(fo, v, "nodes/vel");
+				save_to_file(fo, mass, "nodes/mass");
+				save_to_file(fo, type, "nodes/type");
 			}
 
 			virtual void save_all(Header const &H)
@@ -183,14 +208,23 @@ namespace Conan
 				ss << std::setfill('0') << std::setw(5) << static_cast<int>(round(t * 10000));
 
 				std::string fn = Misc::format(H["new-id"], ".nodes.", ss.str(), ".conan");
-				std::ofstream fo(fn);
 
 				if (H.get<bool>("txt"))
 				{
+					std::ofstream fo(fn);
 					save_nodes_txt(fo, t);
 				}
+				else if (H.get<bool>("hdf5"))
+				{
+					System::HDF5File fo(Misc::format(H["new-id"], ".nodes.", ss.str(), ".h5"),
+						System::HDF5File::WRITE);
+					History I; I.update("<adhesion code>");
+					fo.write_header(H, I);
+					save_nodes_hdf5(fo, t);
+				}
 				else
 				{
+					System::ConanOutput fo(fn);
 					H.to_file(fo);
 					History I; I.update("<adhesion code>"); I.to_file(fo);
 					save_nodes_binary(fo, t);
@@ -1,4 +1,7 @@
 #include "ply.hh"
+#include <zlib.h>
+#include <algorithm>
+#include <memory>
 
 using namespace PLY;
 
@@ -7,21 +10,161 @@ PLY::PLY::PLY(Format format)
     header_.format = format;
 }
 
+static bool is_gzip(std::string const &file_name)
+{
+    return file_name.size() > 3 and
+        file_name.compare(file_name.size() - 3, 3, ".gz") == 0;
+}
+
+namespace
+{
+    /*! stream buffer on a gzip file, so that a PLY is compressed or
+     * decompressed while it is written or read, without holding the
+     * text in memory. Errors from zlib are remembered, and reported
+     * by failed() and close().
+     */
+    class GzBuffer: public std::streambuf
+    {
+        gzFile gz;
+        std::vector<char> buffer;
+        bool error;
+
+        bool flush()
+        {
+            int n = pptr() - pbase();
+            if (n > 0 and gzwrite(gz, pbase(), n) != n)
+                error = true;
+            setp(buffer.data(), buffer.data() + buffer.size());
+            return not error;
+        }
+
+        protected:
+            int_type overflow(int_type c) override
+            {
+                if (not flush())
+                    return traits_type::eof();
+
+                if (not traits_type::eq_int_type(c, traits_type::eof()))
+                {
+                    *pptr() = traits_type::to_char_type(c);
+                    pbump(1);
+                }
+                return traits_type::not_eof(c);
+            }
+
+            // large blocks, such as binary element data, bypass the buffer.
+            std::streamsize xsputn(char const *s, std::streamsize n) override
+            {
+                if (n < epptr() - pptr())
+                    return std::streambuf::xsputn(s, n);
+
+                if (not flush())
+                    return 0;
+
+                for (std::streamsize p = 0; p < n; p += 1 << 30)
+                {
+                    unsigned m = std::min<std::streamsize>(n - p, 1 << 30);
+                    if (gzwrite(gz, s + p, m) != int(m))
+                    {
+                        error = true;
+                        return p;
+                    }
+                }
+                return n;
+            }
+
+            int sync() override
+            {
+                return (pbase() == nullptr or flush() ? 0 : -1);
+            }
+
+            int_type underflow() override
+            {
+                int n = gzread(gz, buffer.data(), buffer.size());
+                if (n < 0) error = true;
+                if (n <= 0) return traits_type::eof();
+
+                setg(buffer.data(), buffer.data(), buffer.data() + n);
+                return traits_type::to_int_type(*gptr());
+            }
+
+        public:
+            GzBuffer(std::string const &file_name, char const *mode):
+                gz(gzopen(file_name.c_str(), mode)), buffer(1 << 16), error(false)
+            {
+                if (gz == nullptr)
+                    throw Exception("could not open " + file_name);
+
+                if (mode[0] == 'w')
+                    setp(buffer.data(), buffer.data() + buffer.size());
+            }
+
+            ~GzBuffer()
+            {
+                if (gz != nullptr) gzclose(gz);
+            }
+
+            bool failed() const { return error; }
+
+            // flushes and closes the file; false if anything failed.
+            bool close()
+            {
+                sync();
+                int r = gzclose(gz);
+                gz = nullptr;
+                return not error and r == Z_OK;
+            }
+    };
+}
+
 PLY::PLY::PLY(std::string const &file_name)
 {
-    std::ifstream fi(file_name, std::ios::binary);
+    std::ifstream raw;
+    std::unique_ptr<GzBuffer> gz;
+    std::istream fi(nullptr);
+
+    if (is_gzip(file_name))
+    {
+        gz.reset(new GzBuffer(file_name, "rb"));
+        fi.rdbuf(gz.get());
+    }
+    else
+    {
+        raw.open(file_name, std::ios::binary);
+        fi.rdbuf(raw.rdbuf());
+    }
+
     fi >> header_;
 
     for (auto const &element : header_)
     {
         data_[element.name] = RecordArray(element.spec, fi, element.size);
     }
+
+    if (gz and gz->failed())
+        throw Exception("could not decompress " + file_name);
 }
 
 void PLY::PLY::save(std::string const &filename) const
 {
+    if (is_gzip(filename))
+    {
+        GzBuffer gz(filename, "wb6");
+        std::ostream out(&gz);
+        write(out);
+
+        if (not out or not gz.close())
+            throw Exception("could not write " + filename);
+        return;
+    }
+
     std::ofstream out(filename);
-    
+    write(out);
+    out.close();
+}
+
+void PLY::PLY::write(std::ostream &out) const
+{
     out << header();
     for (Element const &element : header())
     {
@@ -32,6 +175,4 @@ void PLY::PLY::save(std::string const &filename) const
             out << (*this)[element.name];
         }
     }
-
-    out.close();
 }
@@ -35,11 +35,16 @@ namespace PLY
             /*! constructor, create empty PLY data. */
             PLY(Format format = BINARY);
 
-            /*! constructor, reads data from a file. */
+            /*! constructor, reads data from a file, which is gzipped
+             * if the name ends in .gz. */
             PLY(std::string const &file_name);
 
+            /*! writes the PLY to a file; gzipped if the name ends in .gz. */
             void save(std::string const &filename) const;
 
+            /*! writes the PLY to a stream. */
+            void write(std::ostream &out) const;
+
             /*! get the format (ascii or binary) of the PLY. */
             Format const &format() const
                 { return header_.format; }
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "support/ply/ply.hh"
 #include "generate-wave.hh"
+#include <cstring>
 
 TEST(Ply, WritingASCII)
 {
@@ -37,4 +38,28 @@ TEST(Ply, FaultyBinary)
     ASSERT_THROW(
         PLY::PLY ply2("ply_test_faulty.ply"),
         PLY::Exception);
-}
\ No newline at end of file
+}
+TEST(Ply, Gzipped)
+{
+    PLY::PLY ply(PLY::BINARY);
+    generate_wave(ply);
+    ply.save("ply_test_binary.ply.gz");
+
+    PLY::PLY ply2("ply_test_binary.ply.gz");
+
+    ASSERT_TRUE(ply2.check());
+    ASSERT_EQ(ply2["vertex"].size(), ply["vertex"].size());
+    ASSERT_EQ(ply2["vertex"].byte_size(), ply["vertex"].byte_size());
+    ASSERT_EQ(0, std::memcmp(ply2["vertex"].data(), ply["vertex"].data(),
+        ply["vertex"].byte_size()));
+}
+
+TEST(Ply, GzippedUnwritable)
+{
+    PLY::PLY ply(PLY::BINARY);
+    generate_wave(ply);
+
+    ASSERT_THROW(
+        ply.save("no-such-directory/ply_test.ply.gz"),
+        PLY::Exception);
+}